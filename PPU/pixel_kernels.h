@@ -0,0 +1,288 @@
+/*  pixel_kernels.h
+ *
+ *  Bitplane decoding and palette mapping for the PPU, a generic version (64 bit SWAR on little
+ *  endian hosts, plain loops for the 16 and 32 bit targets) and SSE2 / AVX2 versions on x86.
+ *  Every target format has its own palette kernel. The SIMD functions are compiled with target
+ *  attributes and picked at runtime, so one binary runs on any x86-64.
+ */
+
+#pragma once
+
+#include <string.h>
+#include "../platform/platform.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_KERNELS_X86
+#endif
+
+typedef struct {
+    const char *name;
+
+    // 16 bytes of 2bpp tile data to one colour index per pixel, and the same rows mirrored
+    void (*decode_tile)(const u8 data[16], u8 rows[8][8], u8 flipped[8][8]);
+
+    // out[i] = shades[colors[i]] for n pixels, one per target pixel size
+    void (*map_palette)(u8 *out, const u8 *colors, int n, const u8 shades[4]);
+    void (*map_palette_16)(u16 *out, const u8 *colors, int n, const u16 shades[4]);
+    void (*map_palette_32)(u32 *out, const u8 *colors, int n, const u32 shades[4]);
+} PixelKernels;
+
+#define BYTES_01 0x0101010101010101ULL
+
+/* Byte i of the result is bit i of x */
+static inline u64 spread_bits(u8 x) {
+    u64 v = (x * BYTES_01) & 0x8040201008040201ULL;
+    return ((v + 0x7F7F7F7F7F7F7F7FULL) >> 7) & BYTES_01;
+}
+
+static void decode_tile_swar(const u8 data[16], u8 rows[8][8], u8 flipped[8][8]) {
+    #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (int row = 0; row < 8; row++) {
+        // the leftmost pixel is bit 7, so the spread comes out mirrored, byte i lands at out[i]
+        u64 mirrored = spread_bits(data[row * 2]) | spread_bits(data[row * 2 + 1]) << 1;
+        u64 straight = __builtin_bswap64(mirrored);
+
+        memcpy(flipped[row], &mirrored, 8);
+        memcpy(rows[row], &straight, 8);
+    }
+    #else
+    // the byte lanes above are stored in little endian order, other hosts decode a pixel at a time
+    for (int row = 0; row < 8; row++) {
+        for (int x = 0; x < 8; x++) {
+            u8 bit = 7 - x;
+            u8 color = ((data[row * 2] >> bit) & 1) | ((data[row * 2 + 1] >> bit) & 1) << 1;
+            rows[row][x] = color;
+            flipped[row][7 - x] = color;
+        }
+    }
+    #endif
+}
+
+static void map_palette_swar(u8 *out, const u8 *colors, int n, const u8 shades[4]) {
+    u64 s0 = shades[0] * BYTES_01, s1 = shades[1] * BYTES_01;
+    u64 s2 = shades[2] * BYTES_01, s3 = shades[3] * BYTES_01;
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        u64 c;
+        memcpy(&c, colors + i, 8);
+
+        // 0xFF in every byte whose colour has the bit set
+        u64 m0 = (c & BYTES_01) * 0xFF;
+        u64 m1 = ((c >> 1) & BYTES_01) * 0xFF;
+        u64 v = (~m1 & ((~m0 & s0) | (m0 & s1))) | (m1 & ((~m0 & s2) | (m0 & s3)));
+
+        memcpy(out + i, &v, 8);
+    }
+    for (; i < n; i++)
+        out[i] = shades[colors[i]];
+}
+
+static void map_palette_16_loop(u16 *out, const u8 *colors, int n, const u16 shades[4]) {
+    for (int i = 0; i < n; i++)
+        out[i] = shades[colors[i]];
+}
+
+static void map_palette_32_loop(u32 *out, const u8 *colors, int n, const u32 shades[4]) {
+    for (int i = 0; i < n; i++)
+        out[i] = shades[colors[i]];
+}
+
+// map_palette_swar works lane by lane with no carry between bytes, so it holds on any byte order
+static const PixelKernels pixel_kernels_swar = {
+    "swar", decode_tile_swar, map_palette_swar, map_palette_16_loop, map_palette_32_loop
+};
+
+#ifdef PIXEL_KERNELS_X86
+
+/* Rows r and r + 1 of a tile, 16 colour indices */
+__attribute__((target("sse2")))
+static inline __m128i decode_rows_sse2(const u8 *data, __m128i bits) {
+    __m128i lo = _mm_set_epi64x(data[2] * BYTES_01, data[0] * BYTES_01);
+    __m128i hi = _mm_set_epi64x(data[3] * BYTES_01, data[1] * BYTES_01);
+
+    __m128i lo_set = _mm_cmpeq_epi8(_mm_and_si128(lo, bits), bits);
+    __m128i hi_set = _mm_cmpeq_epi8(_mm_and_si128(hi, bits), bits);
+    return _mm_or_si128(_mm_and_si128(lo_set, _mm_set1_epi8(1)), _mm_and_si128(hi_set, _mm_set1_epi8(2)));
+}
+
+__attribute__((target("sse2")))
+static void decode_tile_sse2(const u8 data[16], u8 rows[8][8], u8 flipped[8][8]) {
+    // bit tested for each pixel, leftmost first
+    const __m128i straight = _mm_set1_epi64x(0x0102040810204080LL);
+    const __m128i mirrored = _mm_set1_epi64x(0x8040201008040201LL);
+
+    for (int row = 0; row < 8; row += 2) {
+        _mm_storeu_si128((__m128i *)rows[row], decode_rows_sse2(data + row * 2, straight));
+        _mm_storeu_si128((__m128i *)flipped[row], decode_rows_sse2(data + row * 2, mirrored));
+    }
+}
+
+__attribute__((target("sse2")))
+static void map_palette_sse2(u8 *out, const u8 *colors, int n, const u8 shades[4]) {
+    __m128i s0 = _mm_set1_epi8(shades[0]);
+    __m128i d1 = _mm_xor_si128(s0, _mm_set1_epi8(shades[1]));
+    __m128i d2 = _mm_xor_si128(s0, _mm_set1_epi8(shades[2]));
+    __m128i d3 = _mm_xor_si128(s0, _mm_set1_epi8(shades[3]));
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(colors + i));
+
+        // the masks are disjoint, each one flips shade 0 to its own shade
+        __m128i v = s0;
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(1)), d1));
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(2)), d2));
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(3)), d3));
+        _mm_storeu_si128((__m128i *)(out + i), v);
+    }
+    map_palette_swar(out + i, colors + i, n - i, shades);
+}
+
+/* 8 pixels a step, the colour indices widened to 16 bit lanes */
+__attribute__((target("sse2")))
+static void map_palette_16_sse2(u16 *out, const u8 *colors, int n, const u16 shades[4]) {
+    __m128i s0 = _mm_set1_epi16(shades[0]);
+    __m128i d1 = _mm_xor_si128(s0, _mm_set1_epi16(shades[1]));
+    __m128i d2 = _mm_xor_si128(s0, _mm_set1_epi16(shades[2]));
+    __m128i d3 = _mm_xor_si128(s0, _mm_set1_epi16(shades[3]));
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(colors + i)), _mm_setzero_si128());
+
+        __m128i v = s0;
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi16(c, _mm_set1_epi16(1)), d1));
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi16(c, _mm_set1_epi16(2)), d2));
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi16(c, _mm_set1_epi16(3)), d3));
+        _mm_storeu_si128((__m128i *)(out + i), v);
+    }
+    map_palette_16_loop(out + i, colors + i, n - i, shades);
+}
+
+/* 4 pixels a step, the colour indices widened to 32 bit lanes */
+__attribute__((target("sse2")))
+static void map_palette_32_sse2(u32 *out, const u8 *colors, int n, const u32 shades[4]) {
+    __m128i s0 = _mm_set1_epi32(shades[0]);
+    __m128i d1 = _mm_xor_si128(s0, _mm_set1_epi32(shades[1]));
+    __m128i d2 = _mm_xor_si128(s0, _mm_set1_epi32(shades[2]));
+    __m128i d3 = _mm_xor_si128(s0, _mm_set1_epi32(shades[3]));
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        u32 packed;
+        memcpy(&packed, colors + i, 4);
+        __m128i c = _mm_cvtsi32_si128(packed);
+        c = _mm_unpacklo_epi16(_mm_unpacklo_epi8(c, _mm_setzero_si128()), _mm_setzero_si128());
+
+        __m128i v = s0;
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi32(c, _mm_set1_epi32(1)), d1));
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi32(c, _mm_set1_epi32(2)), d2));
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi32(c, _mm_set1_epi32(3)), d3));
+        _mm_storeu_si128((__m128i *)(out + i), v);
+    }
+    map_palette_32_loop(out + i, colors + i, n - i, shades);
+}
+
+/* Rows r to r + 3 of a tile, 32 colour indices */
+__attribute__((target("avx2")))
+static inline __m256i decode_rows_avx2(const u8 *data, __m256i bits) {
+    __m256i lo = _mm256_set_epi64x(data[6] * BYTES_01, data[4] * BYTES_01, data[2] * BYTES_01, data[0] * BYTES_01);
+    __m256i hi = _mm256_set_epi64x(data[7] * BYTES_01, data[5] * BYTES_01, data[3] * BYTES_01, data[1] * BYTES_01);
+
+    __m256i lo_set = _mm256_cmpeq_epi8(_mm256_and_si256(lo, bits), bits);
+    __m256i hi_set = _mm256_cmpeq_epi8(_mm256_and_si256(hi, bits), bits);
+    return _mm256_or_si256(_mm256_and_si256(lo_set, _mm256_set1_epi8(1)), _mm256_and_si256(hi_set, _mm256_set1_epi8(2)));
+}
+
+__attribute__((target("avx2")))
+static void decode_tile_avx2(const u8 data[16], u8 rows[8][8], u8 flipped[8][8]) {
+    const __m256i straight = _mm256_set1_epi64x(0x0102040810204080LL);
+    const __m256i mirrored = _mm256_set1_epi64x(0x8040201008040201LL);
+
+    for (int row = 0; row < 8; row += 4) {
+        _mm256_storeu_si256((__m256i *)rows[row], decode_rows_avx2(data + row * 2, straight));
+        _mm256_storeu_si256((__m256i *)flipped[row], decode_rows_avx2(data + row * 2, mirrored));
+    }
+}
+
+__attribute__((target("avx2")))
+static void map_palette_avx2(u8 *out, const u8 *colors, int n, const u8 shades[4]) {
+    __m256i s0 = _mm256_set1_epi8(shades[0]);
+    __m256i d1 = _mm256_xor_si256(s0, _mm256_set1_epi8(shades[1]));
+    __m256i d2 = _mm256_xor_si256(s0, _mm256_set1_epi8(shades[2]));
+    __m256i d3 = _mm256_xor_si256(s0, _mm256_set1_epi8(shades[3]));
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(colors + i));
+
+        __m256i v = s0;
+        v = _mm256_xor_si256(v, _mm256_and_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(1)), d1));
+        v = _mm256_xor_si256(v, _mm256_and_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(2)), d2));
+        v = _mm256_xor_si256(v, _mm256_and_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(3)), d3));
+        _mm256_storeu_si256((__m256i *)(out + i), v);
+    }
+
+    // stays in this function, calling the non VEX SSE2 code with the upper halves dirty stalls
+    for (; i < n; i++)
+        out[i] = shades[colors[i]];
+}
+
+__attribute__((target("avx2")))
+static void map_palette_16_avx2(u16 *out, const u8 *colors, int n, const u16 shades[4]) {
+    __m256i s0 = _mm256_set1_epi16(shades[0]);
+    __m256i d1 = _mm256_xor_si256(s0, _mm256_set1_epi16(shades[1]));
+    __m256i d2 = _mm256_xor_si256(s0, _mm256_set1_epi16(shades[2]));
+    __m256i d3 = _mm256_xor_si256(s0, _mm256_set1_epi16(shades[3]));
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(colors + i)));
+
+        __m256i v = s0;
+        v = _mm256_xor_si256(v, _mm256_and_si256(_mm256_cmpeq_epi16(c, _mm256_set1_epi16(1)), d1));
+        v = _mm256_xor_si256(v, _mm256_and_si256(_mm256_cmpeq_epi16(c, _mm256_set1_epi16(2)), d2));
+        v = _mm256_xor_si256(v, _mm256_and_si256(_mm256_cmpeq_epi16(c, _mm256_set1_epi16(3)), d3));
+        _mm256_storeu_si256((__m256i *)(out + i), v);
+    }
+    for (; i < n; i++)
+        out[i] = shades[colors[i]];
+}
+
+/* The colour indices pick their lane of the shades directly */
+__attribute__((target("avx2")))
+static void map_palette_32_avx2(u32 *out, const u8 *colors, int n, const u32 shades[4]) {
+    __m256i table = _mm256_setr_epi32(shades[0], shades[1], shades[2], shades[3], 0, 0, 0, 0);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i c = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(colors + i)));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permutevar8x32_epi32(table, c));
+    }
+    for (; i < n; i++)
+        out[i] = shades[colors[i]];
+}
+
+static const PixelKernels pixel_kernels_sse2 = {
+    "sse2", decode_tile_sse2, map_palette_sse2, map_palette_16_sse2, map_palette_32_sse2
+};
+static const PixelKernels pixel_kernels_avx2 = {
+    "avx2", decode_tile_avx2, map_palette_avx2, map_palette_16_avx2, map_palette_32_avx2
+};
+#endif
+
+/* Kernel sets the host can run, best first, returns how many */
+static inline int pixel_kernels_supported(const PixelKernels *sets[3]) {
+    int n = 0;
+
+    #ifdef PIXEL_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) sets[n++] = &pixel_kernels_avx2;
+    if (__builtin_cpu_supports("sse2")) sets[n++] = &pixel_kernels_sse2;
+    #endif
+
+    sets[n++] = &pixel_kernels_swar;
+    return n;
+}
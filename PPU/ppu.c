@@ -2,6 +2,12 @@
 #include "memory.h"
 #include "../platform/platform.h"
 #include <stdbool.h>
+#include <string.h>
+#include "pixel_kernels.h"
+
+#ifdef BENCH
+#include <time.h>
+#endif
 
 #define LCDC 0xFF40
 #define STAT 0xFF41
@@ -12,6 +18,7 @@
 #define BGP  0xFF47
 #define OBP0 0xFF48
 #define OBP1 0xFF49
+#define DMA  0xFF46
 #define WY   0xFF4A
 #define WX   0xFF4B
 
@@ -22,41 +29,114 @@
 
 
 
-static inline u8 bg_palette(PPU *ppu, u8 c) {
-    u8 p = memory_read_8(ppu->p_mem, BGP);
-    return (p >> (c * 2)) & 3;
+// bitplane decode and palette mapping, the best set the host supports
+static const PixelKernels *kernels = &pixel_kernels_swar;
+
+/* The PPU's own registers, read without the catch-up sync memory_read_8 does for the CPU */
+static inline u8 ppu_reg(PPU *ppu, u16 addr) {
+    return ppu->p_mem->IO[addr - 0xFF00];
 }
 
-static inline u8 obj_palette(PPU *ppu, u8 c, bool pal1) {
-    u8 p = memory_read_8(ppu->p_mem, pal1 ? OBP1 : OBP0);
-    return (p >> (c * 2)) & 3;
+/* Host pixels of the shades a palette register maps the four colour indices to */
+static inline void palette_pixels(PPU *ppu, u16 addr) {
+    u8 p = ppu_reg(ppu, addr);
+    for (int c = 0; c < 4; c++)
+        ppu->palettes[addr - BGP][c] = ppu->target.shades[(p >> (c * 2)) & 3];
 }
 
 static inline u8 get_lcdc(PPU *ppu) {
-    return memory_read_8(ppu->p_mem, LCDC);
+    return ppu_reg(ppu, LCDC);
 }
 
 
 
 static void stat_update(PPU *ppu) {
-    u8 stat = memory_read_8(ppu->p_mem, STAT);
+    u8 stat = ppu->stat;
 
     stat = (stat & ~0x03) | (ppu->mode & 3);
 
-    u8 lyc = memory_read_8(ppu->p_mem, LYC);
+    u8 lyc = ppu_reg(ppu, LYC);
     if (ppu->ly == lyc)
         stat |= (1 << 2);
     else
         stat &= ~(1 << 2);
 
-    ppu->p_mem->stat_shadow = stat;
+    ppu->stat = stat;
+}
+
+
+static u8 stat_read(void *ctx, u16 addr) {
+    (void)addr;
+    return ((PPU *)ctx)->stat;
+}
+
+static void stat_write(void *ctx, u16 addr, u8 data) {
+    (void)addr;
+    PPU *ppu = ctx;
+    // mode and coincidence bits are read only
+    ppu->stat = (ppu->stat & 0x07) | (data & 0x78);
+}
+
+static void dma_write(void *ctx, u16 addr, u8 data) {
+    (void)addr;
+    PPU *ppu = ctx;
+    u16 src = data << 8;
+
+    u8 oam[160];
+    for (int i = 0; i < 160; i++) {
+        oam[i] = *get_address(ppu->p_mem, src + i, false);
+    }
+
+    // games copy their sprite table every frame, mostly unchanged
+    if (memcmp(ppu->p_mem->OAM, oam, 160) == 0) return;
+    memcpy(ppu->p_mem->OAM, oam, 160);
+    ppu->p_mem->oam_dirty = true;
+    ppu->p_mem->oam_gen++;
+}
+
+static void palette_write(void *ctx, u16 addr, u8 data) {
+    PPU *ppu = ctx;
+    ppu->p_mem->IO[addr - 0xFF00] = data;
+    palette_pixels(ppu, addr);
+}
+
+#ifdef LOG
+static u8 ly_read_log(void *ctx, u16 addr) {
+    (void)ctx;
+    (void)addr;
+    return 0x90; // TODO: change this just for experiment
+}
+#else
+/* LY is read only, a CPU write only lands in IO[] and never reads back */
+static u8 ly_read(void *ctx, u16 addr) {
+    (void)addr;
+    return ((PPU *)ctx)->ly;
+}
+#endif
+
+void ppu_register_io(PPU *ppu) {
+    const PixelKernels *sets[3];
+    pixel_kernels_supported(sets);
+    kernels = sets[0];
+
+    for (u16 addr = BGP; addr <= OBP1; addr++) {
+        memory_register_io(ppu->p_mem, addr, NULL, palette_write, ppu);
+    }
+
+    memory_register_io(ppu->p_mem, STAT, stat_read, stat_write, ppu);
+    memory_register_io(ppu->p_mem, DMA, NULL, dma_write, ppu);
+    #ifdef LOG
+    memory_register_io(ppu->p_mem, LY, ly_read_log, NULL, ppu);
+    #else
+    memory_register_io(ppu->p_mem, LY, ly_read, NULL, ppu);
+    #endif
 }
 
 
 static void stat_check(PPU *ppu) {
     bool old = ppu->stat_irq_line;
     bool now = false;
-    u8 stat = ppu->p_mem->stat_shadow;
+    u8 stat = ppu->stat;
 
     if (ppu->mode == 0 && (stat & (1 << 3))) now = true;
     if (ppu->mode == 1 && (stat & (1 << 4))) now = true;
@@ -71,122 +151,167 @@ static void stat_check(PPU *ppu) {
 
 
 
+static void decode_tile(PPU *ppu, int tile) {
+    kernels->decode_tile(&ppu->p_mem->VRAM[tile * 16], ppu->tiles[tile], ppu->tiles_flipped[tile]);
+    ppu->p_mem->tile_dirty[tile] = 0;
+}
+
+/* Colour indices of one row of a tile, tile counts 16 byte blocks from 0x8000 */
+static inline const u8 *tile_row(PPU *ppu, int tile, int row, bool flip_x) {
+    if (ppu->p_mem->tile_dirty[tile])
+        decode_tile(ppu, tile);
+
+    return flip_x ? ppu->tiles_flipped[tile][row] : ppu->tiles[tile][row];
+}
+
+/* Colour indices of pixels [x, end) of the line from a tile map row, a tile row at a time. px is the
+ * map column of the first pixel and wraps around the 256 pixel map, only the first and last tiles are partial.
+ */
+static void render_map_span(PPU *ppu, u8 bg_line[160], u8 lcdc, u16 map, u8 px, u8 py, int x, int end) {
+    const u8 *map_row = &ppu->p_mem->VRAM[map - 0x8000 + (py >> 3) * 32];
+
+    while (x < end) {
+        u8 tile = map_row[px >> 3];
+        int index =
+            (lcdc & (1 << 4))
+            ? tile
+            : 256 + (s8)tile;
+
+        const u8 *row = tile_row(ppu, index, py & 7, false) + (px & 7);
+        int n = 8 - (px & 7);
+        if (n > end - x) n = end - x;
+
+        memcpy(&bg_line[x], row, n);
+        x += n;
+        px += n;
+    }
+}
+
+/* Takes the platform's buffer for the next frame, the palettes are mapped to its pixels again */
+static void acquire_target(PPU *ppu) {
+    ppu->target = begin_frame(ppu->draw_ctx);
+    ppu->has_target = true;
+
+    for (u16 addr = BGP; addr <= OBP1; addr++)
+        palette_pixels(ppu, addr);
+}
+
+/* Host pixels [x, x + n) of line y from colour indices */
+static void store_span(PPU *ppu, int y, int x, const u8 *colors, int n, const u32 pixels[4]) {
+    u8 *line = ppu->target.pixels + y * ppu->target.pitch;
+
+    switch (ppu->target.format) {
+    case PIXEL_INDEX: {
+        u8 shades[4] = {pixels[0], pixels[1], pixels[2], pixels[3]};
+        kernels->map_palette(line + x, colors, n, shades);
+        break;
+    }
+    case PIXEL_RGB565: {
+        u16 shades[4] = {pixels[0], pixels[1], pixels[2], pixels[3]};
+        kernels->map_palette_16((u16 *)line + x, colors, n, shades);
+        break;
+    }
+    case PIXEL_RGBA8888:
+        kernels->map_palette_32((u32 *)line + x, colors, n, pixels);
+        break;
+    }
+}
+
+static inline void store_pixel(PPU *ppu, int x, u32 pixel) {
+    u8 *line = ppu->target.pixels + ppu->ly * ppu->target.pitch;
+
+    switch (ppu->target.format) {
+    case PIXEL_INDEX:    line[x] = pixel; break;
+    case PIXEL_RGB565:   ((u16 *)line)[x] = pixel; break;
+    case PIXEL_RGBA8888: ((u32 *)line)[x] = pixel; break;
+    }
+}
+
+/* Whether the window shows on the current line, every line it does moves window_line on */
+static inline bool window_on_line(PPU *ppu) {
+    u8 lcdc = ppu_reg(ppu, LCDC);
+    return (lcdc & 1) && (lcdc & (1 << 5)) && ppu->ly >= ppu_reg(ppu, WY) && ppu_reg(ppu, WX) - 7 < 160;
+}
+
 static void render_bg_window(PPU *ppu, u8 bg_line[160]) {
-    u8 lcdc = memory_read_8(ppu->p_mem, LCDC);
+    u8 lcdc = ppu_reg(ppu, LCDC);
 
     bool bg_enable = lcdc & 1;
-    bool win_enable = lcdc & (1 << 5);
+
+    if (!bg_enable) {
+        memset(bg_line, 0, 160);
+        store_span(ppu, ppu->ly, 0, bg_line, 160, ppu->palettes[0]);
+        return;
+    }
 
     u8 scx = ppu->latched_scx;
     u8 scy = ppu->latched_scy;
-    u8 wy  = memory_read_8(ppu->p_mem, WY);
-    int wx = memory_read_8(ppu->p_mem, WX) - 7;
-
-    bool window_active = false;
-
-    for (int x = 0; x < 160; x++) {
-        u8 color = 0;
-
-        if (bg_enable) {
-            bool use_win =
-                win_enable &&
-                ppu->ly >= wy &&
-                x >= wx;
-
-            u16 map;
-            u8 px, py;
-
-            if (use_win) {
-                map = (lcdc & (1 << 6)) ? TILE_MAP_1 : TILE_MAP_0;
-                px = x - wx;
-                py = ppu->window_line;
-                window_active = true;
-            } else {
-                map = (lcdc & (1 << 3)) ? TILE_MAP_1 : TILE_MAP_0;
-                px = x + scx;
-                py = ppu->ly + scy;
-            }
+    int wx = ppu_reg(ppu, WX) - 7;
 
-            u8 tx = px >> 3;
-            u8 ty = py >> 3;
-            u8 fx = px & 7;
-            u8 fy = py & 7;
+    // the window covers the line from wx to the right edge
+    int win_x = 160;
+    if (window_on_line(ppu))
+        win_x = wx < 0 ? 0 : wx;
 
-            u8 tile = memory_read_8(ppu->p_mem, map + ty * 32 + tx);
+    u16 bg_map = (lcdc & (1 << 3)) ? TILE_MAP_1 : TILE_MAP_0;
+    render_map_span(ppu, bg_line, lcdc, bg_map, scx, ppu->ly + scy, 0, win_x);
 
-            u16 addr =
-                (lcdc & (1 << 4))
-                ? 0x8000 + tile * 16
-                : 0x9000 + ((s8)tile) * 16;
+    if (win_x < 160) {
+        u16 win_map = (lcdc & (1 << 6)) ? TILE_MAP_1 : TILE_MAP_0;
+        render_map_span(ppu, bg_line, lcdc, win_map, win_x - wx, ppu->window_line, win_x, 160);
+        ppu->window_line++;
+    }
 
-            addr += fy * 2;
+    store_span(ppu, ppu->ly, 0, bg_line, 160, ppu->palettes[0]);
+}
 
-            u8 lo = memory_read_8(ppu->p_mem, addr);
-            u8 hi = memory_read_8(ppu->p_mem, addr + 1);
+/* Picks the first 10 sprites of every line in OAM order, each list is kept sorted by X with ties in OAM order */
+static void build_line_sprites(PPU *ppu, int sprite_h) {
+    const u8 *oam = ppu->p_mem->OAM;
+    memset(ppu->line_sprite_count, 0, sizeof(ppu->line_sprite_count));
 
-            u8 bit = 7 - fx;
-            color = ((hi >> bit) & 1) << 1 | ((lo >> bit) & 1);
-        }
+    for (int i = 0; i < 40; i++) {
+        int sy = oam[i * 4] - 16;
+        int sx = oam[i * 4 + 1];
 
-        bg_line[x] = color;
-        ppu->frame_buffer[ppu->ly][x] = bg_palette(ppu, color);
+        for (int ly = sy < 0 ? 0 : sy; ly < sy + sprite_h && ly < SCREEN_HEIGHT; ly++) {
+            u8 *list = ppu->line_sprites[ly];
+            int n = ppu->line_sprite_count[ly];
+            if (n == 10) continue;
+
+            // sprites come in OAM order, an equal X stays in front
+            while (n > 0 && oam[list[n - 1] * 4 + 1] > sx) {
+                list[n] = list[n - 1];
+                n--;
+            }
+            list[n] = i;
+            ppu->line_sprite_count[ly]++;
+        }
     }
 
-    if (window_active)
-        ppu->window_line++;
+    ppu->sprites_height = sprite_h;
+    ppu->p_mem->oam_dirty = false;
 }
 
 static void render_sprites(PPU *ppu, u8 bg_line[160]) {
-    u8 lcdc = memory_read_8(ppu->p_mem, LCDC);
+    u8 lcdc = ppu_reg(ppu, LCDC);
     if (!(lcdc & (1 << 1))) return;
 
     int sprite_h = (lcdc & (1 << 2)) ? 16 : 8;
-    
-    typedef struct {
-        int idx;
-        int x;
-    } SpriteInfo;
-    
-    SpriteInfo sprites[10];
-    int sprite_count = 0;
-
-    for (int i = 0; i < 40 && sprite_count < 10; i++) {
-        u16 o = OAM_BASE + i * 4;
-        int sy = memory_read_8(ppu->p_mem, o) - 16;
-        int sx = memory_read_8(ppu->p_mem, o + 1) - 8;
-
-        if (ppu->ly >= sy && ppu->ly < sy + sprite_h) {
-            sprites[sprite_count].idx = i;
-            sprites[sprite_count].x = sx;
-            sprite_count++;
-        }
-    }
+    if (ppu->p_mem->oam_dirty || ppu->sprites_height != sprite_h)
+        build_line_sprites(ppu, sprite_h);
 
-    for (int i = 0; i < sprite_count - 1; i++) {
-        for (int j = i + 1; j < sprite_count; j++) {
-            bool swap = false;
-            if (sprites[i].x > sprites[j].x) {
-                swap = true;
-            } else if (sprites[i].x == sprites[j].x && sprites[i].idx > sprites[j].idx) {
-                swap = true;
-            }
-            
-            if (swap) {
-                SpriteInfo temp = sprites[i];
-                sprites[i] = sprites[j];
-                sprites[j] = temp;
-            }
-        }
-    }
+    const u8 *sprites = ppu->line_sprites[ppu->ly];
+    const u8 *oam = ppu->p_mem->OAM;
 
-    for (int s = sprite_count - 1; s >= 0; s--) {
-        int i = sprites[s].idx;
-        u16 o = OAM_BASE + i * 4;
+    // the front sprite is drawn last
+    for (int s = ppu->line_sprite_count[ppu->ly] - 1; s >= 0; s--) {
+        const u8 *o = &oam[sprites[s] * 4];
 
-        int sy = memory_read_8(ppu->p_mem, o) - 16;
-        int sx = memory_read_8(ppu->p_mem, o + 1) - 8;
-        u8 tile = memory_read_8(ppu->p_mem, o + 2);
-        u8 attr = memory_read_8(ppu->p_mem, o + 3);
+        int sy = o[0] - 16;
+        int sx = o[1] - 8;
+        u8 tile = o[2];
+        u8 attr = o[3];
 
         bool flip_x = attr & (1 << 5);
         bool flip_y = attr & (1 << 6);
@@ -197,21 +322,19 @@ static void render_sprites(PPU *ppu, u8 bg_line[160]) {
         if (flip_y) y = sprite_h - 1 - y;
         if (sprite_h == 16) tile &= 0xFE;
 
-        u16 addr = 0x8000 + tile * 16 + y * 2;
-        u8 lo = memory_read_8(ppu->p_mem, addr);
-        u8 hi = memory_read_8(ppu->p_mem, addr + 1);
+        // 8x16 sprites run into the next tile
+        const u8 *row = tile_row(ppu, tile + (y >> 3), y & 7, flip_x);
 
         for (int px = 0; px < 8; px++) {
             int x = sx + px;
             if (x < 0 || x >= 160) continue;
 
-            int bit = flip_x ? px : (7 - px);
-            u8 c = ((hi >> bit) & 1) << 1 | ((lo >> bit) & 1);
+            u8 c = row[px];
             if (c == 0) continue;
 
             if (behind && bg_line[x] != 0) continue;
 
-            ppu->frame_buffer[ppu->ly][x] = obj_palette(ppu, c, pal1);
+            store_pixel(ppu, x, ppu->palettes[pal1 ? 2 : 1][c]);
         }
     }
 }
@@ -219,90 +342,220 @@ static void render_sprites(PPU *ppu, u8 bg_line[160]) {
 static void render_scanline(PPU *ppu) {
     u8 bg_line[160] = {0};
 
+    if (!ppu->has_target)
+        acquire_target(ppu);
+
     render_bg_window(ppu, bg_line);
     render_sprites(ppu, bg_line);
 }
 
 
 
-void step_ppu(PPU *ppu, int cycles) {
-    u8 lcdc = memory_read_8(ppu->p_mem, LCDC);
-    screen_event_loop(ppu->draw_ctx); // remvo
+/* Mode lengths in M-cycles, HBlank, one VBlank line, OAM scan and drawing */
+static const int mode_cycles[4] = {51, 114, 20, 43};
 
-    if (!(lcdc & 0x80)) {
-        ppu->mode = 0;
-        ppu->ly = 0;
-        ppu->window_line = 0;
-        ppu->m_cycles = 0;
-        memory_write(ppu->p_mem, LY, 0);
-        stat_update(ppu);
+/* Switches mode at the current event, the next one is due a mode length later */
+static void enter_mode(PPU *ppu, u8 mode) {
+    ppu->mode = mode;
+    ppu->next_event += mode_cycles[mode];
+    stat_update(ppu);
+    stat_check(ppu);
+}
+
+/* Everything render_scanline reads, the palettes as their registers */
+static LineKey line_key(PPU *ppu) {
+    LineKey key;
+    memset(&key, 0, sizeof(key)); // the padding is compared too
+
+    key.vram_gen = ppu->p_mem->vram_gen;
+    key.oam_gen = ppu->p_mem->oam_gen;
+    key.valid = true;
+    key.lcdc = ppu_reg(ppu, LCDC);
+    key.scx = ppu->latched_scx;
+    key.scy = ppu->latched_scy;
+    key.wx = ppu_reg(ppu, WX);
+    key.wy = ppu_reg(ppu, WY);
+    key.window_line = ppu->window_line;
+    for (int i = 0; i < 3; i++)
+        key.palettes[i] = ppu_reg(ppu, BGP + i);
+    return key;
+}
+
+/* Draws the line unless the target already holds it as it would come out now */
+static void update_scanline(PPU *ppu) {
+    LineKey key = line_key(ppu);
+    u8 ly = ppu->ly;
+
+    if (memcmp(&key, &ppu->presented[ly], sizeof(key)) != 0)
+        ppu->frame_changed = true;
+
+    if (memcmp(&key, &ppu->drawn[ly], sizeof(key)) == 0) {
+        if (window_on_line(ppu))
+            ppu->window_line++;
         return;
     }
 
-    ppu->m_cycles += cycles;
+    render_scanline(ppu);
+    ppu->drawn[ly] = key;
+}
+
+/* Lines the target got no pixels for, line 0 after the LCD is switched on, get BG colour 0 instead of what the buffer held */
+static void blank_undrawn_lines(PPU *ppu) {
+    static const u8 blank[160];
+
+    for (int y = 0; y < SCREEN_HEIGHT; y++)
+        if (!ppu->drawn[y].valid)
+            store_span(ppu, y, 0, blank, 160, ppu->palettes[0]);
+}
+
+/* Whether the frame after this one is only timed, its lines are not drawn and it is not presented */
+static bool skip_next_frame(PPU *ppu) {
+    bool skip;
+
+    if (ppu->frame_skip == FRAME_SKIP_AUTO) {
+        // asked every frame, the platform keeps its own count of them
+        bool behind = frame_behind(ppu->draw_ctx);
+        skip = behind && ppu->skipped < FRAME_SKIP_AUTO_MAX;
+    } else {
+        skip = ppu->skipped < ppu->frame_skip;
+    }
+
+    ppu->skipped = skip ? ppu->skipped + 1 : 0;
+    return skip;
+}
 
+/* The mode transition due at ppu->next_event */
+static void ppu_event(PPU *ppu) {
     switch (ppu->mode) {
 
-    case 2:  
-        if (ppu->m_cycles >= 20) {
-            ppu->m_cycles -= 20;
-            ppu->latched_scx = memory_read_8(ppu->p_mem, SCX);
-            ppu->latched_scy = memory_read_8(ppu->p_mem, SCY);
-            ppu->mode = 3;
-            stat_update(ppu);
-            stat_check(ppu);
-        }
+    case 2:
+        ppu->latched_scx = ppu_reg(ppu, SCX);
+        ppu->latched_scy = ppu_reg(ppu, SCY);
+        enter_mode(ppu, 3);
         break;
 
-    case 3: 
-        if (ppu->m_cycles >= 43) {
-            ppu->m_cycles -= 43;
-            render_scanline(ppu);
-            ppu->mode = 0;
-            stat_update(ppu);
-            stat_check(ppu);
-        }
+    case 3:
+        if (ppu->draw_frame)
+            update_scanline(ppu);
+        enter_mode(ppu, 0);
         break;
 
-    case 0:  
-        if (ppu->m_cycles >= 51) {
-            ppu->m_cycles -= 51;
-            ppu->ly++;
-            memory_write(ppu->p_mem, LY, ppu->ly);
-
-            if (ppu->ly == 144) {
-                ppu->mode = 1;
-                stat_update(ppu);
-                stat_check(ppu);
-                request_interrupt(ppu->ih, VBlank);
-                present_framebuffer(ppu->draw_ctx, ppu->frame_buffer);
-                // screen_event_loop(ppu->draw_ctx);
-            } else {
-                ppu->mode = 2;
-                stat_update(ppu);
-                stat_check(ppu);
+    case 0:
+        ppu->ly++;
+
+        if (ppu->ly == 144) {
+            enter_mode(ppu, 1);
+            request_interrupt(ppu->ih, VBlank);
+            // a frame the same as the one on screen is only taken when the platform wants to show it again,
+            // otherwise the target is kept for the next one and nothing is uploaded
+            if (ppu->draw_frame && (ppu->frame_changed || ppu->has_target)) {
+                if (!ppu->has_target)
+                    acquire_target(ppu);
+                if (!ppu->target.persistent)
+                    blank_undrawn_lines(ppu);
+
+                if (present_frame(ppu->draw_ctx, ppu->frame_changed)) {
+                    ppu->has_target = false;
+                    memcpy(ppu->presented, ppu->drawn, sizeof(ppu->drawn));
+                    if (!ppu->target.persistent)
+                        memset(ppu->drawn, 0, sizeof(ppu->drawn));
+                    ppu->frame_changed = false;
+                }
             }
+            ppu->draw_frame = !skip_next_frame(ppu);
+        } else {
+            enter_mode(ppu, 2);
         }
         break;
 
-    case 1:  
-        if (ppu->m_cycles >= 114) {
-            ppu->m_cycles -= 114;
-            ppu->ly++;
-            memory_write(ppu->p_mem, LY, ppu->ly);
-            stat_update(ppu);
-            stat_check(ppu);
-
-            if (ppu->ly >= 154) {
-                ppu->ly = 0;
-                ppu->window_line = 0;
-                memory_write(ppu->p_mem, LY, 0);
-                ppu->mode = 2;
-                stat_update(ppu);
-                stat_check(ppu);
-            }
+    case 1:
+        ppu->ly++;
+        stat_update(ppu);
+        stat_check(ppu);
+
+        if (ppu->ly < 154) {
+            ppu->next_event += mode_cycles[1];
+            break;
         }
+        ppu->ly = 0;
+        ppu->window_line = 0;
+        enter_mode(ppu, 2);
         break;
     }
-    screen_event_loop(ppu->draw_ctx);
-}
\ No newline at end of file
+}
+
+/* Runs the mode transitions due up to the master clock, nothing happens between them */
+void ppu_sync(PPU *ppu) {
+    u64 now = *ppu->clock;
+
+    if (!(ppu_reg(ppu, LCDC) & 0x80)) {
+        // held at the start of line 0, the first HBlank runs from when the LCD is turned on
+        ppu->mode = 0;
+        ppu->ly = 0;
+        ppu->window_line = 0;
+        ppu->next_event = now + mode_cycles[0];
+        stat_update(ppu);
+        ppu->synced = now;
+        return;
+    }
+
+    while (ppu->next_event <= now)
+        ppu_event(ppu);
+    ppu->synced = now;
+}
+
+/* M-cycles until the next mode transition, any interrupt the PPU raises happens on one */
+int ppu_cycles_to_event(PPU *ppu) {
+    // with the LCD off nothing happens, keep syncing a line at a time for the event loop
+    if (!(ppu_reg(ppu, LCDC) & 0x80))
+        return 114;
+
+    if (ppu->next_event <= ppu->synced + 1)
+        return 1;
+    return (int)(ppu->next_event - ppu->synced);
+}
+
+/* M-cycles until LY changes, VBlank is requested on one of these */
+int ppu_cycles_to_ly_change(PPU *ppu) {
+    // modes left on the line after the current one
+    static const int line_rest[4] = {0, 0, 43 + 51, 51};
+
+    if (!(ppu_reg(ppu, LCDC) & 0x80))
+        return 114;
+
+    return ppu_cycles_to_event(ppu) + line_rest[ppu->mode & 3];
+}
+
+#ifdef BENCH
+#define PPU_BENCH_FRAMES 2000
+
+/* Times render_scanline in isolation on the current VRAM and OAM, once per kernel set the host runs */
+void ppu_bench_render(PPU *ppu) {
+    const PixelKernels *sets[3];
+    int count = pixel_kernels_supported(sets);
+    const PixelKernels *active = kernels;
+    u8 ly = ppu->ly, window_line = ppu->window_line;
+
+    for (int k = 0; k < count; k++) {
+        kernels = sets[k];
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int frame = 0; frame < PPU_BENCH_FRAMES; frame++) {
+            // the tiles in use are decoded again once per frame
+            memset(ppu->p_mem->tile_dirty, 1, sizeof(ppu->p_mem->tile_dirty));
+            ppu->window_line = 0;
+            for (ppu->ly = 0; ppu->ly < SCREEN_HEIGHT; ppu->ly++)
+                render_scanline(ppu);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / (PPU_BENCH_FRAMES * SCREEN_HEIGHT);
+        printf("[BENCH] render_scanline with %s kernels: %.1f ns per line\n", sets[k]->name, ns);
+    }
+
+    kernels = active;
+    ppu->ly = ly;
+    ppu->window_line = window_line;
+}
+#endif
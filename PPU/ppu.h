@@ -1,25 +1,72 @@
 #include "../interrupts/interrupts.h"
 #include "../platform/platform.h"
 
+// what a line is drawn from, two lines with the same key come out the same
+typedef struct {
+    u32 vram_gen;
+    u32 oam_gen;
+    bool valid;
+    u8 lcdc;
+    u8 scx;
+    u8 scy;
+    u8 wx;
+    u8 wy;
+    u8 window_line;
+    u8 palettes[3];
+} LineKey;
+
 typedef struct{
     Memory *p_mem;
     u8 mode;
-    int m_cycles;
+    u64 next_event; // master clock of the next mode transition
     u8 ly;
     InterruptManager *ih;
-    u8 frame_buffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+
+    FrameTarget target; // where the frame is drawn, taken from the platform at the first line drawn
+    bool has_target;
+
+    int frame_skip;  // FRAME_SKIP or FRAME_SKIP_AUTO
+    u8 skipped;      // frames skipped in a row
+    bool draw_frame; // the current frame is drawn and presented, decided at the previous VBlank
+
+    LineKey drawn[SCREEN_HEIGHT];     // what the lines the target holds were drawn from
+    LineKey presented[SCREEN_HEIGHT]; // the same for the frame on screen
+    bool frame_changed;               // a line of this frame differs from the one on screen
+
+    u32 palettes[3][4]; // host pixel of each colour index under BGP, OBP0 and OBP1, refreshed on writes
 
     u8 latched_scx;
     u8 latched_scy;
     
     bool lcd_prev;
     bool stat_irq_line;
+    u8 stat; // FF41 is owned by both cpu and ppu
 
 
     u8 window_line;
 
+    // tiles of 0x8000 - 0x97FF decoded to one colour index per pixel, and mirrored for X flipped sprites,
+    // redone when memory marks the tile dirty
+    u8 tiles[0x1800 / 16][8][8];
+    u8 tiles_flipped[0x1800 / 16][8][8];
+
+    // OAM indices of the sprites on each line ordered by X then index, rebuilt when OAM or the sprite height changes
+    u8 line_sprites[SCREEN_HEIGHT][10];
+    u8 line_sprite_count[SCREEN_HEIGHT];
+    u8 sprites_height;
+
     
+    const u64 *clock; // master clock, CPU.cycles
+    u64 synced;       // master clock the PPU was last stepped up to
+
     struct DrawingContext *draw_ctx;
 }PPU;
 
-void step_ppu(PPU *ppu, int cycles);
\ No newline at end of file
+void ppu_sync(PPU *ppu);
+int ppu_cycles_to_event(PPU *ppu);
+int ppu_cycles_to_ly_change(PPU *ppu);
+void ppu_register_io(PPU *ppu);
+
+#ifdef BENCH
+void ppu_bench_render(PPU *ppu);
+#endif
\ No newline at end of file
@@ -5,7 +5,6 @@
 #include "../processor/cpu.h"
 #include <stdbool.h>
 
-#define IE 0xFFFF
 #define IF 0xFF0F
 
 u16 IVT[] = {
@@ -23,43 +22,35 @@ InterruptManager make_interrupt_manager(CPU *cpu){
 }
 
 
+/* Peripherals raise IF bits from inside a sync, straight into IO[] so they do not sync again */
 void request_interrupt(InterruptManager *im, INTERRUPTS _int){
-    u8 prev = memory_read_8(im->cpu->p_memory, IF);
-    prev |= (1 << _int);
-    memory_write(im->cpu->p_memory,IF,prev);
+    Memory *mem = im->cpu->p_memory;
+    mem->IO[IF - 0xFF00] |= (1 << _int);
+    memory_update_pending(mem);
     // printf("WROTE REQ INTERRUPT %d\n",_int);
 }
 
 int handle_interrupt(InterruptManager *im){
-    u8 ie = memory_read_8(im->cpu->p_memory,IE);
-    u8 _if = memory_read_8(im -> cpu->p_memory, IF);
+    Memory *mem = im->cpu->p_memory;
+    u8 pending = mem->pending;
 
-    if ((ie & _if) && im->cpu->is_halted){
-        im->cpu->is_halted = false;
-    }
+    if (!pending)
+        return 0;
+
+    im->cpu->is_halted = false;
 
     if (!im->cpu->IME)
         return 0 ;
 
-    // for all interrupts
-    for(int i=0; i<=4; i++){
-        if (((ie>>i) & (0b1)) == 1) {
-            // means the corresponding interrupt is enabled
-            if (((_if>>i) & (0b1)) == 1){
-                // means being requested
-                im->cpu->IME = 0; // reset the ime 
+    // lowest set bit is the highest priority
+    int i = __builtin_ctz(pending);
+    im->cpu->IME = 0; // reset the ime
 
-                 // reset the corresponding IF 
-                 u8 new_if = memory_read_8(im->cpu->p_memory, IF);
-                new_if &= ~(1 << i);
-                memory_write(im->cpu->p_memory, IF, new_if);
-                
-                // rst is the same thing  as calling
-                rst_helper(im->cpu, IVT[i]);
-                return 5;
-            }
+    // reset the corresponding IF
+    mem->IO[IF - 0xFF00] &= ~(1 << i);
+    memory_update_pending(mem);
 
-        }
-    }
-    return 0;
+    // rst is the same thing  as calling
+    rst_helper(im->cpu, IVT[i]);
+    return 5;
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <errno.h>
+#include <time.h>
 
 
 #include "platform/platform.h"
@@ -10,6 +12,7 @@
 #include "interrupts/interrupts.h"
 #include "timer/timer.h"
 #include "PPU/ppu.h"
+#include "scheduler/scheduler.h"
 
 void verify_cartridge_header(const u8 *p_cartridge){
 	// Just fetching the title
@@ -27,6 +30,95 @@ void verify_cartridge_header(const u8 *p_cartridge){
 
 }
 
+// longest polling loop skip, one frame
+#define IDLE_MAX_CYCLES (154 * 114)
+
+/* Cycles the halted CPU sleeps through in one go, up to the next timer or PPU event */
+static int halt_cycles(Timer_Manager *tm, PPU *ppu){
+	Memory *mem = tm->cpu->p_memory;
+
+	// handle_interrupt wakes the CPU on the next check
+	if (mem->pending)
+		return 1;
+
+	int timer_cycles = timer_cycles_to_overflow(tm);
+	int ppu_cycles = ppu_cycles_to_event(ppu);
+	return timer_cycles < ppu_cycles ? timer_cycles : ppu_cycles;
+}
+
+/* M-cycles a polling loop at PC spins through before its register can change */
+static int idle_cycles(CPU *cpu, Timer_Manager *tm, PPU *ppu){
+	u16 polled;
+	int iteration = cpu_idle_loop(cpu, &polled);
+	if (iteration == 0)
+		return 0;
+
+	u8 ie = memory_read_8(cpu->p_memory, 0xFFFF);
+	int event = IDLE_MAX_CYCLES;
+
+	// events that change the polled value or raise an interrupt the CPU would take
+	int timer_cycles = timer_cycles_to_change(tm, polled);
+	if (polled == 0xFF04 || polled == 0xFF05 || polled == 0xFF0F || (cpu->IME && (ie & (1 << Timer))))
+		event = timer_cycles < event ? timer_cycles : event;
+
+	int ly_cycles = ppu_cycles_to_ly_change(ppu);
+	if (polled == 0xFF44 || (cpu->IME && (ie & (1 << VBlank))))
+		event = ly_cycles < event ? ly_cycles : event;
+
+	int ppu_cycles = ppu_cycles_to_event(ppu);
+	if (polled == 0xFF41 || polled == 0xFF0F || (cpu->IME && (ie & (1 << LCD)) && (ppu->stat & 0x78)))
+		event = ppu_cycles < event ? ppu_cycles : event;
+
+	// whole iterations that end before the event, the one that sees it runs normally
+	return ((event - 1) / iteration) * iteration;
+}
+
+typedef struct {
+	Timer_Manager *tm;
+	PPU *ppu;
+} Sync;
+
+/* Brings the timer and PPU up to the master clock, also runs before every IO write so they see the cycles before it under the old value */
+static void sync_catch_up(void *ctx){
+	Sync *sync = ctx;
+
+	timer_sync(sync->tm);
+	ppu_sync(sync->ppu);
+}
+
+/* Components post where their state next changes in a way the CPU can see */
+static void schedule(Scheduler *sched, Timer_Manager *tm, PPU *ppu){
+	scheduler_post(sched, EVENT_TIMER, timer_cycles_to_event(tm));
+	scheduler_post(sched, EVENT_PPU, ppu_cycles_to_event(ppu));
+}
+
+#ifdef IDLE_STATS
+static const u8 *idle_title;
+static long idle_skips, idle_skipped;
+
+static void idle_stats_dump(void){
+	printf("[IDLE] %.16s: %ld polling loops skipped, %ld M-cycles\n", (const char *)idle_title, idle_skips, idle_skipped);
+}
+#endif
+
+#ifdef EXIT_STATE
+static const CPU *exit_cpu;
+
+/* What the acceptance roms report through registers, the JIT differential check compares it next to the frames */
+static void exit_state_dump(void){
+	const Memory *mem = exit_cpu->p_memory;
+	u64 io = 0xCBF29CE484222325ULL;
+
+	for (int i = 0; i < 0x80; i++){
+		io ^= mem->IO[i];
+		io *= 0x100000001B3ULL;
+	}
+	printf("STATE AF=%04x BC=%04x DE=%04x HL=%04x SP=%04x PC=%04x cycles=%llu IE=%02x IF=%02x IO=%016llx\n",
+		exit_cpu->AF.val, exit_cpu->BC.val, exit_cpu->DE.val, exit_cpu->HL.val, exit_cpu->SP.val, exit_cpu->PC.val,
+		(unsigned long long)exit_cpu->cycles, mem->IE, mem->IO[0x0F], (unsigned long long)io);
+}
+#endif
+
 int main(){
 	Cartridge cartridge = load_cartridge();
 	
@@ -37,6 +129,11 @@ int main(){
 
 	verify_cartridge_header(cartridge.rom);
 
+	#ifdef IDLE_STATS
+	idle_title = cartridge.rom + 0x134;
+	atexit(idle_stats_dump);
+	#endif
+
 		Jpad jp = {	};
 	struct DrawingContext *dr_ctx=make_screen(&jp);
 	
@@ -48,39 +145,122 @@ int main(){
 		},
 		.ctx = &jp,
 	};
+	memory_map_init(&memory);
 
 	CPU cpu = init_cpu(&memory);
+	cpu_register_block_cache(&cpu);
+
+	#ifdef EXIT_STATE
+	exit_cpu = &cpu;
+	atexit(exit_state_dump);
+	#endif
+
+	#ifdef JIT
+	const char *jit = getenv("KHEL_JIT");
+	cpu.jit_enabled = (jit == NULL || jit[0] != '0');
+	#endif
+
+	const char *skip = getenv("KHEL_FRAME_SKIP");
+	int frame_skip = FRAME_SKIP;
+	if (skip != NULL)
+		frame_skip = strcmp(skip, "auto") == 0 ? FRAME_SKIP_AUTO : atoi(skip);
 
 	InterruptManager im = make_interrupt_manager(&cpu);
 	Timer_Manager tm = make_timer(&cpu, &im);
+	timer_register_io(&tm);
 
 
 
 	PPU ppu = {
 		.p_mem = &memory,
 		.mode = 2,
-		.m_cycles = 0,
+		.next_event = 20, // end of the first OAM scan
 		.ly = 0,
 		.ih = &im,
-		.frame_buffer = {{0}},
+		.has_target = false,
+		.frame_skip = frame_skip,
+		.draw_frame = true,
+		.clock = &cpu.cycles,
+		.synced = cpu.cycles,
 		.draw_ctx = dr_ctx,
 	};
+	ppu_register_io(&ppu);
+
+	int int_cycles=0;
+
+	#ifdef BENCH
+	long executed = 0;
+	struct timespec bench_start, bench_end;
+	clock_gettime(CLOCK_MONOTONIC, &bench_start);
+	#endif
 
-	int cpu_cycles=0, int_cycles=0;
+	Scheduler sched = make_scheduler(&cpu.cycles);
+	#ifdef JIT
+	cpu.deadline = &sched.next;
+	#endif
+	Sync sync = {.tm = &tm, .ppu = &ppu};
+	memory.io_sync = sync_catch_up;
+	memory.io_sync_ctx = &sync;
+	u16 polled;
+	u64 next_input = INPUT_POLL_CYCLES;
 
 	for (int i = 0; i<=ITERATION; i++){
+		#ifdef BENCH
+		if (!cpu.is_halted) executed++;
+		#endif
 		
-		cpu_cycles = step_cpu(&cpu);
-		timer_step(&tm,cpu_cycles);
-		step_ppu(&ppu,cpu_cycles);
+		u16 prev_pc = cpu.PC.val;
+		if (cpu.is_halted)
+			cpu.cycles += halt_cycles(&tm, &ppu);
+		else
+			step_cpu(&cpu);
+
+		// nothing the CPU can see changes before the deadline, unless it writes IO or takes an interrupt
+		if (cpu.cycles < sched.next && !memory.io_written && !cpu.is_halted &&
+			!(cpu.IME && memory.pending) &&
+			!(cpu.PC.val < prev_pc && cpu_idle_loop(&cpu, &polled)))
+			continue;
+
+		sync_catch_up(&sync);
 
 		int_cycles = handle_interrupt(&im);
 
 		if(int_cycles){
-		timer_step(&tm,int_cycles);
-		step_ppu(&ppu,int_cycles);}
+			cpu.cycles += int_cycles;
+			sync_catch_up(&sync);
+		}
+
+		// a backward jump may have closed a polling loop
+		else if (cpu.PC.val < prev_pc){
+			int idle = idle_cycles(&cpu, &tm, &ppu);
+			if (idle){
+				cpu.cycles += idle;
+				sync_catch_up(&sync);
+				#ifdef IDLE_STATS
+				idle_skips++;
+				idle_skipped += idle;
+				#endif
+			}
+		}
+
+		// input is pumped on emulated time, also while the LCD is off and no frames are presented
+		if (cpu.cycles >= next_input){
+			screen_event_loop(dr_ctx);
+			next_input = cpu.cycles + INPUT_POLL_CYCLES;
+		}
+
+		memory.io_written = false;
+		schedule(&sched, &tm, &ppu);
 	}
 
+	#ifdef BENCH
+	clock_gettime(CLOCK_MONOTONIC, &bench_end);
+	double seconds = (bench_end.tv_sec - bench_start.tv_sec) + (bench_end.tv_nsec - bench_start.tv_nsec) / 1e9;
+	printf("[BENCH] %ld instructions in %.3fs, %.2f M instructions/s\n", executed, seconds, executed / seconds / 1e6);
+	memory_bench_reads(&memory);
+	ppu_bench_render(&ppu);
+	#endif
+
 	free(cartridge.rom);
 	cleanup_screen(dr_ctx);
 }
@@ -8,13 +8,32 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <error.h>
 #include "../platform/platform.h"
 
+#ifdef BENCH
+#include <time.h>
+#endif
+
 
 typedef uint8_t u8;
 typedef uint16_t  u16;
 
+/* IO register callbacks, ctx is whatever the owning module registered */
+typedef u8 (*io_read_fn)(void *ctx, u16 addr);
+typedef void (*io_write_fn)(void *ctx, u16 addr, u8 data);
+
+// why a page is left out of write_map, the fast path only comes back once every reason is gone
+#define WRITE_TRAP_VRAM 0x01 // tile_dirty and vram_gen
+#define WRITE_TRAP_CODE 0x02 // decoded blocks, BLOCK_CACHE
+
+typedef struct {
+    io_read_fn read;
+    io_write_fn write;
+    void *ctx;
+} IOHandler;
+
 typedef struct
 {
     Cartridge *p_cartidge;
@@ -29,115 +48,172 @@ typedef struct
     u8 IE;
     u8 ERAM[0x2000];
 
-    bool is_div_reset;
-    u8 stat_shadow;
+    // one handler per register in 0xFF00 - 0xFF7F, NULL means plain storage in IO[]
+    IOHandler io_handlers[0x80];
+
+    // writes to 0xFF00 - 0xFF7F and IE call io_sync first, so the peripherals catch up under the old value,
+    // reads of the timer, IF and LCD registers call it so they see the current value
+    void (*io_sync)(void *ctx);
+    void *io_sync_ctx;
+    bool io_written; // the main loop reschedules after the instruction
+
+    u8 pending; // IE & IF, kept up to date by every write to either
+
+    // one flag per 16 byte tile in 0x8000 - 0x97FF, set by writes so the PPU decodes the tile again
+    u8 tile_dirty[0x1800 / 16];
+    bool oam_dirty; // set by OAM writes and DMA, the PPU rebuilds its per line sprite lists
+
+    // bumped by writes that change VRAM or OAM, a line drawn under the same counts and registers comes out the same
+    u32 vram_gen;
+    u32 oam_gen;
+
+    // one entry per 256 byte page, NULL pages are handled by get_io_address
+    u8 *read_map[0x100];
+    u8 *write_map[0x100];
+    // WRITE_TRAP_* reasons a page's writes go through get_io_address, one byte per page
+    u8 write_trap[0x100];
+
+    #ifdef BLOCK_CACHE
+    // one bit per address the cpu has decoded into its block cache
+    u8 code_map[0x10000 / 8];
+    // drops the cpu blocks decoded from a page, registered by cpu_register_block_cache
+    void (*code_written)(void *ctx, u8 page);
+    void *code_ctx;
+    #endif
 }Memory;
 
 
-static inline u8 *get_address(Memory *p_mem, const u16 addr, const bool is_writing){
-    if (addr<= 0x7FFF){
-        // Cartridge Rom
-        #ifdef DEBUG
-            printf(" FROM CARTRIDGE ROM AT: %.4xH\n]",addr);
-        #endif
-        return &p_mem->p_cartidge->rom[addr];
-    }
+/* Hooks an IO register, a NULL read or write keeps the plain storage behaviour */
+static inline void memory_register_io(Memory *p_mem, u16 addr, io_read_fn read, io_write_fn write, void *ctx){
+    p_mem->io_handlers[addr - 0xFF00] = (IOHandler){
+        .read = read,
+        .write = write,
+        .ctx = ctx,
+    };
+}
 
-    //DMA
-    if (addr == 0xFF46 && is_writing == true){
-        printf("DMA\n");
-        exit(0);
-    }
+/* Recomputes the pending interrupt mask after IE or IF changed */
+static inline void memory_update_pending(Memory *p_mem){
+    p_mem->pending = p_mem->IE & p_mem->IO[0x0F] & 0x1F;
+}
 
-    if (addr == 0xFF04 && is_writing == true){
-        // writing to div resets it to 0
-        printf("DIV CAME\n");
-        exit(0);
-    }
+static inline u8 joypad_read(void *ctx, u16 addr){
+    Memory *p_mem = ctx;
+    u8 val = p_mem->IO[addr - 0xFF00];   // whatever was written
+    u8 res = 0xC0 | (val & 0x30) | 0x0F;
 
-    if (addr >= 0x8000 && addr <=0x9FFF){
-        // VRAM
-        return &p_mem -> VRAM[addr - 0x8000];
+    // buttons
+    if (!(val & 0b00100000)) {
+        if (p_mem->ctx->a)      res &= ~(1 << 0);
+        if (p_mem->ctx->b)      res &= ~(1 << 1);
+        if (p_mem->ctx->select) res &= ~(1 << 2);
+        if (p_mem->ctx->start)  res &= ~(1 << 3);
     }
 
-    if (addr >=0xa000 && addr <=0xbfff){
-        // external ram
-        return &p_mem -> ERAM[addr - 0xa000];
+    // d pad
+    if (!(val & 0b00010000)) {
+        if (p_mem->ctx->right) res &= ~(1 << 0);
+        if (p_mem->ctx->left)  res &= ~(1 << 1);
+        if (p_mem->ctx->up)    res &= ~(1 << 2);
+        if (p_mem->ctx->down)  res &= ~(1 << 3);
     }
 
-    else if (addr >= 0xC000 && addr <= 0xDFFF){
-        // WRAM 
-        #ifdef DEBUG
-            printf(" FROM WRAM AT: %x]\n",addr);
-        #endif
-        return &p_mem -> WRAM[addr - 0xC000];
-    }
+    return res;
+}
 
-    else if (addr >= 0xFF80 && addr <= 0xFFFE){
-        // high ram area
-        return &p_mem -> HRAM [addr - 0xFF80];
-    }
+/* Sends writes to a page through get_io_address */
+static inline void memory_trap_writes(Memory *p_mem, const u8 page, const u8 reason){
+    p_mem->write_trap[page] |= reason;
+    p_mem->write_map[page] = NULL;
+}
 
-    else if (addr>= 0xff04 && addr <= 0xff07){
-        // some timer shit 
-        return &p_mem -> IO[addr - 0xFF00];
-    }
-    else if (addr== 0xff0f){
-        // Interrupt Flag 
-        return &p_mem -> IO[addr - 0xFF00];
-    }
-    else if(addr >=0xE000 && addr <= 0xFDFF){
-        return &p_mem -> WRAM[addr - 0xE000];
-    }
-    else if (addr== 0xffff){
-        // Interrupt Enable
-        return &p_mem -> IE;
-    }
-    else if (addr== 0xff26){
-        // audio shit 
-        return &p_mem -> IO[addr - 0xFF00];
-    }
-    else if (addr== 0xff25){
-        // audio sound panning shit 
-        return &p_mem -> IO[addr - 0xFF00];
-    }
-    else if (addr== 0xff24){
-        // audio master volume shit 
-        return &p_mem -> IO[addr - 0xFF00];
-    }
+/* Drops one reason, the page is writable in place again only when no other one holds it */
+static inline void memory_untrap_writes(Memory *p_mem, const u8 page, const u8 reason){
+    p_mem->write_trap[page] &= ~reason;
+    if (p_mem->write_trap[page] == 0)
+        p_mem->write_map[page] = p_mem->read_map[page];
+}
 
-    else if (addr == 0xff40){
-     
-        return &p_mem -> IO[addr - 0xFF00];
-    }
-    else if (addr == 0xff41){
-     
-        return &p_mem -> IO[addr - 0xFF00];
-    }
-    else if (addr == 0xff4b || addr == 0xff4a || addr == 0xff06 || addr == 0xff48 || addr == 0xff49 || addr == 0xff44){
-        // idk what this is 
-     
-        return &p_mem -> IO[addr - 0xFF00];
-    }
-    else if(addr >=0xFF00 && addr<=0xFF7F){
-        return &p_mem -> IO[addr -0xFF00];
-    }
+/* Builds the page tables, call once before the first memory access */
+static inline void memory_map_init(Memory *p_mem){
+    for (int page = 0; page < 0x100; page++){
+        u8 *base = NULL;
+
+        if (page <= 0x7F)
+            // Cartridge Rom
+            base = &p_mem->p_cartidge->rom[page << 8];
+        else if (page <= 0x9F)
+            // VRAM
+            base = &p_mem->VRAM[(page - 0x80) << 8];
+        else if (page <= 0xBF)
+            // external ram
+            base = &p_mem->ERAM[(page - 0xA0) << 8];
+        else if (page <= 0xDF)
+            // WRAM
+            base = &p_mem->WRAM[(page - 0xC0) << 8];
+        else if (page <= 0xFD)
+            // echo of WRAM
+            base = &p_mem->WRAM[(page - 0xE0) << 8];
+
+        // OAM and IO/HRAM pages are left NULL and go through the slow path
+        p_mem->read_map[page] = base;
+        p_mem->write_map[page] = base;
+    }
+
+    // VRAM writes are trapped to mark the tile and count the change
+    for (int page = 0x80; page <= 0x9F; page++)
+        memory_trap_writes(p_mem, page, WRITE_TRAP_VRAM);
+    memset(p_mem->tile_dirty, 1, sizeof(p_mem->tile_dirty));
+    p_mem->oam_dirty = true;
+
+    memory_register_io(p_mem, 0xFF00, joypad_read, NULL, p_mem);
+}
 
+#ifdef BLOCK_CACHE
+/* Echo ram shares its bytes with WRAM, code bits are kept on the WRAM address */
+static inline u16 code_address(const u16 addr){
+    return (addr >= 0xE000 && addr <= 0xFDFF) ? addr - 0x2000 : addr;
+}
 
-    else if (addr == 0xFF42 || addr == 0xFF43){
-        // scrolling not implemented
-        return &p_mem -> IO[addr - 0xFF00];
-    }
-    else if (addr == 0xFF47){
-                // pallete not implemented
-        return &p_mem -> IO[addr - 0xFF00];
-    }
-    else if (addr == 0xFF01 || addr == 0xFF02){
-        // serial transfer not implemented
-        return &p_mem -> IO [addr - 0xFF00];
-    }
-    else if (addr >=0xFE00 && addr <=0xFE9F){
+/* Marks decoded bytes, writes to their page are trapped into get_io_address */
+static inline void memory_mark_code(Memory *p_mem, const u16 addr){
+    p_mem->code_map[addr >> 3] |= 1 << (addr & 7);
+
+    u8 page = addr >> 8;
+    if (page < 0xFE) memory_trap_writes(p_mem, page, WRITE_TRAP_CODE);
+    if (page >= 0xC0 && page <= 0xDD) memory_trap_writes(p_mem, page + 0x20, WRITE_TRAP_CODE);
+}
+
+/* A write to a trapped page, drops the page's blocks if it hits decoded code */
+static inline void memory_code_write(Memory *p_mem, const u16 addr){
+    u16 code = code_address(addr);
+    if (!(p_mem->code_map[code >> 3] & (1 << (code & 7)))) return;
+
+    u8 page = code >> 8;
+    memset(&p_mem->code_map[page << 5], 0, 0x100 / 8);
+    if (p_mem->code_written != NULL) p_mem->code_written(p_mem->code_ctx, page);
+
+    // only the code trap is dropped, a page trapped for another reason (VRAM) keeps going through get_io_address
+    if (page < 0xFE) memory_untrap_writes(p_mem, page, WRITE_TRAP_CODE);
+    if (page >= 0xC0 && page <= 0xDD) memory_untrap_writes(p_mem, page + 0x20, WRITE_TRAP_CODE);
+}
+#endif
+
+/* Slow path for the 0xFE and 0xFF pages, VRAM writes and pages trapped by the block cache */
+static inline u8 *get_io_address(Memory *p_mem, const u16 addr, const bool is_writing){
+    if (addr >= 0x8000 && addr <= 0x9FFF){
+        if (is_writing){
+            if (addr <= 0x97FF) p_mem->tile_dirty[(addr - 0x8000) >> 4] = 1;
+            p_mem->vram_gen++;
+        }
+        return &p_mem->VRAM[addr - 0x8000];
+    }
+    if (addr >=0xFE00 && addr <=0xFE9F){
         // oam
+        if (is_writing){
+            p_mem->oam_dirty = true;
+            p_mem->oam_gen++;
+        }
         return &p_mem ->OAM[addr - 0xFE00];
     }
     else if (addr >=0xFEA0 && addr <=0xFEFF){
@@ -145,12 +221,49 @@ static inline u8 *get_address(Memory *p_mem, const u16 addr, const bool is_writi
         return &p_mem -> NU[addr-0xFEA0];
     }
 
+    if(addr >=0xFF00 && addr<=0xFF7F){
+        return &p_mem -> IO[addr -0xFF00];
+    }
+    else if (addr >= 0xFF80 && addr <= 0xFFFE){
+        // high ram area
+        #ifdef BLOCK_CACHE
+        if (is_writing) memory_code_write(p_mem, addr);
+        #endif
+        return &p_mem -> HRAM [addr - 0xFF80];
+    }
+    else if (addr== 0xffff){
+        // Interrupt Enable
+        return &p_mem -> IE;
+    }
+    #ifdef BLOCK_CACHE
+    else if (addr < 0xFE00 && is_writing){
+        // page holding decoded code
+        memory_code_write(p_mem, addr);
+        return &p_mem->read_map[addr >> 8][addr & 0xFF];
+    }
+    #endif
     else{
         printf("NOT IMPLEMENTED MEMORY LOCATION %x\n",addr);
         exit(1);
         return NULL;
     }
+}
 
+static inline u8 *get_address(Memory *p_mem, const u16 addr, const bool is_writing){
+    u8 *page = is_writing ? p_mem->write_map[addr >> 8] : p_mem->read_map[addr >> 8];
+
+    if (page != NULL){
+        #ifdef DEBUG
+            printf(" FROM PAGE %.2xH AT: %.4xH]\n", addr >> 8, addr);
+        #endif
+        return &page[addr & 0xFF];
+    }
+    return get_io_address(p_mem, addr, is_writing);
+}
+
+/* Registers whose value depends on how far the timer and PPU have run */
+static inline bool memory_io_synced(const u16 addr){
+    return (addr >= 0xFF04 && addr <= 0xFF07) || addr == 0xFF0F || (addr >= 0xFF40 && addr <= 0xFF4B);
 }
 
 static inline u8  memory_read_8(Memory *p_mem, const u16 addr){
@@ -158,88 +271,86 @@ static inline u8  memory_read_8(Memory *p_mem, const u16 addr){
         printf("READING ");
     #endif
 
-    if (addr == 0xFF00) {
-    u8 val = p_mem->IO[0];   // whatever was written
-    u8 res = 0xC0 | (val & 0x30) | 0x0F;
+    u8 *page = p_mem->read_map[addr >> 8];
+    if (page != NULL) return page[addr & 0xFF];
 
-    // buttons
-    if (!(val & 0b00100000)) {
-        if (p_mem->ctx->a)      res &= ~(1 << 0);
-        if (p_mem->ctx->b)      res &= ~(1 << 1);
-        if (p_mem->ctx->select) res &= ~(1 << 2);
-        if (p_mem->ctx->start)  res &= ~(1 << 3);
+    if (addr >= 0xFF00 && addr <= 0xFF7F){
+        if (p_mem->io_sync != NULL && memory_io_synced(addr)) p_mem->io_sync(p_mem->io_sync_ctx);
+        IOHandler *h = &p_mem->io_handlers[addr - 0xFF00];
+        if (h->read != NULL) return h->read(h->ctx, addr);
+        return p_mem->IO[addr - 0xFF00];
     }
 
-    // d pad
-    if (!(val & 0b00010000)) {
-        if (p_mem->ctx->right) res &= ~(1 << 0);
-        if (p_mem->ctx->left)  res &= ~(1 << 1);
-        if (p_mem->ctx->up)    res &= ~(1 << 2);
-        if (p_mem->ctx->down)  res &= ~(1 << 3);
-    }
-
-    return res;
+    return *get_io_address(p_mem, addr, false);
 }
 
-    else if(addr == 0xFF41){
-        // FF41 is owned by both cpu and ppu
-        return p_mem->stat_shadow;
-    }
 
-    if (addr == 0xFF44){
-        #ifdef LOG
-            return 0x90; // TODO: change this just for experiment
-        #endif
-    }
-   
-    u8 *add =  get_address(p_mem,addr,false);
-    if (add == NULL){
-        printf("Reading Unimplemented memory location %x\n",addr);
-        exit(0);
-    }
-    return *add;
-}
-
-
-static inline void dma_start(Memory *mem, u8 value) {
-    u16 src = value << 8;
+static inline void memory_write(Memory *p_mem, const u16 addr, const u8 data){
+    #ifdef DEBUG
+        printf("WRITING  AT: %x and Value: %x\n",addr,data);
+    #endif
 
-    for (int i = 0; i < 160; i++) {
-        *get_address(mem,0xFE00 + i,true) = *get_address(mem,src+i,false);
+    u8 *page = p_mem->write_map[addr >> 8];
+    if (page != NULL){
+        page[addr & 0xFF] = data;
+        return;
     }
-}
-
 
-static inline void memory_write(Memory *p_mem, const u16 addr, const u8 data){
-    if (addr == 0xFF41){
-         u8 old = p_mem->stat_shadow;
-        u8 masked = (old & 0x07) | (data & 0x78);
-        p_mem->stat_shadow = masked;
+    if (addr >= 0xFF00 && addr <= 0xFF7F){
+        if (p_mem->io_sync != NULL) p_mem->io_sync(p_mem->io_sync_ctx);
+        p_mem->io_written = true;
+        IOHandler *h = &p_mem->io_handlers[addr - 0xFF00];
+        if (h->write != NULL) h->write(h->ctx, addr, data);
+        else p_mem->IO[addr - 0xFF00] = data;
+        if (addr == 0xFF0F) memory_update_pending(p_mem);
         return;
     }
-    //DMA
-    if (addr == 0xFF46){
-       dma_start(p_mem,data);
-       return;
-    }
 
-    if (addr == 0xFF04){
-        // writing to div resets it to 0
-        p_mem->is_div_reset = true;
-        return ;
+    if (addr == 0xFFFF){
+        if (p_mem->io_sync != NULL) p_mem->io_sync(p_mem->io_sync_ctx);
+        p_mem->io_written = true;
+        p_mem->IE = data;
+        memory_update_pending(p_mem);
+        return;
     }
 
+    // VRAM and OAM only count writes that change something, games often store what is already there
+    if (addr >= 0x8000 && addr <= 0x9FFF && p_mem->VRAM[addr - 0x8000] == data) return;
+    if (addr >= 0xFE00 && addr <= 0xFE9F && p_mem->OAM[addr - 0xFE00] == data) return;
 
-    u8 *add =  get_address(p_mem,addr,true);
-    
-    if (add == NULL){
-        printf("Writing Unimplemented memory location %x and data %x\n",addr, data);
-        exit(0);
-    }
-    #ifdef DEBUG
-        printf("WRITING  AT: %x and Value: %x\n",addr,data);
-    #endif
-    *add = data;  
+    *get_io_address(p_mem, addr, true) = data;
 }
 
-
+#ifdef BENCH
+#define MEMORY_BENCH_ADDRESSES 0x10000
+#define MEMORY_BENCH_ROUNDS 2000
+
+/* Times memory_read_8 over a fixed mix of addresses: 60% ROM, 20% WRAM, 8% HRAM, 7% VRAM, 5% LCD registers */
+static inline void memory_bench_reads(Memory *p_mem){
+    static u16 addrs[MEMORY_BENCH_ADDRESSES];
+    u32 seed = 1;
+
+    for (int i = 0; i < MEMORY_BENCH_ADDRESSES; i++){
+        seed = seed * 1664525 + 1013904223;
+        u32 pick = (seed >> 8) % 100, offset = seed >> 16;
+
+        if (pick < 60)      addrs[i] = offset & 0x7FFF;
+        else if (pick < 80) addrs[i] = 0xC000 + (offset & 0x1FFF);
+        else if (pick < 88) addrs[i] = 0xFF80 + offset % 0x7F;
+        else if (pick < 95) addrs[i] = 0x8000 + (offset & 0x1FFF);
+        else                addrs[i] = 0xFF40 + offset % 12;
+    }
+
+    u8 sum = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < MEMORY_BENCH_ROUNDS; round++)
+        for (int i = 0; i < MEMORY_BENCH_ADDRESSES; i++)
+            sum += memory_read_8(p_mem, addrs[i]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double reads = (double)MEMORY_BENCH_ROUNDS * MEMORY_BENCH_ADDRESSES;
+    printf("[BENCH] memory_read_8: %.1f M reads/s (checksum %u)\n", reads / seconds / 1e6, sum);
+}
+#endif
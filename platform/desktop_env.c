@@ -12,6 +12,11 @@
 #define FILE_TO_LOAD "test_roms/tetris.gb"
 #define SCALE 4
 
+// what the PPU draws in and the texture holds, PIXEL_RGBA8888 or PIXEL_RGB565
+#ifndef DESKTOP_PIXEL_FORMAT
+#define DESKTOP_PIXEL_FORMAT PIXEL_RGBA8888
+#endif
+
 static const uint8_t dmg_palette[4][3] = {
     {155, 188, 15},  // Lightest
     {139, 172, 15},  // Light
@@ -24,10 +29,46 @@ struct DrawingContext {
     SDL_Renderer *renderer;
     SDL_Texture  *texture;  
     Jpad *jp;
+    u64 frame_deadline; // performance counter the current emulated frame is due by
+
+    bool locked;    // the PPU holds the texture, begin_frame to present_frame
+    bool shown;     // the texture holds a presented frame
+    bool repaint;   // a window event needs the last frame presented again
+    bool presented; // a frame was presented, and waited on vsync, since the last screen_event_loop
+    u64 idle_deadline; // performance counter a frame with nothing presented is held until
 };
 
+/* Shows the texture, it is uploaded when unlocked */
+static void render_texture(struct DrawingContext *ctx) {
+    SDL_RenderClear(ctx->renderer);
+    SDL_RenderCopy(ctx->renderer, ctx->texture, NULL, NULL);
+    SDL_RenderPresent(ctx->renderer);
+}
+
+/* Vsync only paces presented frames, a static screen or a skipped frame waits out its own time here */
+static void hold_unpresented_frame(struct DrawingContext *ctx) {
+    u64 now = SDL_GetPerformanceCounter();
+    u64 freq = SDL_GetPerformanceFrequency();
+    u64 frame = freq * 70224 / 4194304;
+
+    // counting starts again after a presented frame, or when too far behind to ever catch up
+    if (ctx->presented || ctx->idle_deadline == 0 || now > ctx->idle_deadline + 8 * frame) {
+        ctx->presented = false;
+        ctx->idle_deadline = now + frame;
+        return;
+    }
+
+    if (now < ctx->idle_deadline)
+        SDL_Delay((u32)((ctx->idle_deadline - now) * 1000 / freq));
+    while (SDL_GetPerformanceCounter() < ctx->idle_deadline)
+        ;
+    ctx->idle_deadline += frame;
+}
+
 void screen_event_loop(struct DrawingContext *context) {
     SDL_Event e;
+
+    hold_unpresented_frame(context);
     
     while (SDL_PollEvent(&e) != 0) {
         if (e.type == SDL_QUIT) {
@@ -36,6 +77,15 @@ void screen_event_loop(struct DrawingContext *context) {
             exit(0);
         }
 
+        // a static screen presents nothing, the window still has to be redrawn
+        if (e.type == SDL_WINDOWEVENT &&
+            (e.window.event == SDL_WINDOWEVENT_EXPOSED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)) {
+            if (context->locked)
+                context->repaint = true;
+            else if (context->shown)
+                render_texture(context);
+        }
+
         if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
 
             bool pressed = (e.type == SDL_KEYDOWN);
@@ -77,6 +127,12 @@ struct DrawingContext *make_screen(Jpad *jpp) {
     
     struct DrawingContext *context = (struct DrawingContext *) malloc(sizeof(struct DrawingContext));
     context->texture = NULL;
+    context->frame_deadline = 0;
+    context->locked = false;
+    context->shown = false;
+    context->repaint = false;
+    context->presented = false;
+    context->idle_deadline = 0;
 
     context->window = SDL_CreateWindow(
         "Khel-Babu",
@@ -108,7 +164,7 @@ struct DrawingContext *make_screen(Jpad *jpp) {
 
     context->texture = SDL_CreateTexture(
         context->renderer,
-        SDL_PIXELFORMAT_RGB24,
+        DESKTOP_PIXEL_FORMAT == PIXEL_RGB565 ? SDL_PIXELFORMAT_RGB565 : SDL_PIXELFORMAT_RGBA8888,
         SDL_TEXTUREACCESS_STREAMING,
         SCREEN_WIDTH,
         SCREEN_HEIGHT
@@ -174,23 +230,51 @@ Cartridge load_cartridge() {
     return (Cartridge) {.rom = pcartridge, .length = elements_read};
 }
 
-void present_framebuffer(struct DrawingContext *ctx, u8 framebuffer[144][160]) {
-    static uint8_t pixels[SCREEN_HEIGHT * SCREEN_WIDTH * 3];
-
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-            u8 color = framebuffer[y][x] & 3;
-            const u8 *rgb = dmg_palette[color];
-            
-            int idx = (y * SCREEN_WIDTH + x) * 3;
-            pixels[idx + 0] = rgb[0];
-            pixels[idx + 1] = rgb[1];
-            pixels[idx + 2] = rgb[2];
-        }
+/* The PPU draws straight into the locked streaming texture, SDL does not keep its pixels across a lock.
+ * The lock is held over unchanged frames, so they are never uploaded.
+ */
+FrameTarget begin_frame(struct DrawingContext *ctx) {
+    FrameTarget target = {.format = DESKTOP_PIXEL_FORMAT, .persistent = false};
+    void *pixels;
+
+    SDL_LockTexture(ctx->texture, NULL, &pixels, &target.pitch);
+    target.pixels = pixels;
+    ctx->locked = true;
+
+    for (int i = 0; i < 4; i++) {
+        const u8 *rgb = dmg_palette[i];
+        target.shades[i] = DESKTOP_PIXEL_FORMAT == PIXEL_RGB565
+            ? (u32)(rgb[0] >> 3) << 11 | (rgb[1] >> 2) << 5 | rgb[2] >> 3
+            : (u32)rgb[0] << 24 | rgb[1] << 16 | rgb[2] << 8 | 0xFF;
     }
+    return target;
+}
 
-    SDL_UpdateTexture(ctx->texture, NULL, pixels, SCREEN_WIDTH * 3);
-    SDL_RenderClear(ctx->renderer);
-    SDL_RenderCopy(ctx->renderer, ctx->texture, NULL, NULL);
-    SDL_RenderPresent(ctx->renderer);
-}
\ No newline at end of file
+/* An unchanged frame is only unlocked, uploaded and presented again after a window event,
+ * screen_event_loop holds it to the frame rate instead of vsync
+ */
+bool present_frame(struct DrawingContext *ctx, bool changed) {
+    if (!changed && !ctx->repaint) return false;
+
+    SDL_UnlockTexture(ctx->texture);
+    ctx->locked = false;
+    ctx->shown = true;
+    ctx->repaint = false;
+
+    render_texture(ctx);
+    ctx->presented = true;
+    return true;
+}
+
+/* Emulated frames are held against the wall clock, one lasts 70224 / 4194304 s */
+bool frame_behind(struct DrawingContext *ctx) {
+    u64 now = SDL_GetPerformanceCounter();
+    u64 frame = SDL_GetPerformanceFrequency() * 70224 / 4194304;
+
+    // the first frame, or too far behind to ever catch up, counting starts again from now
+    if (ctx->frame_deadline == 0 || now > ctx->frame_deadline + 8 * frame)
+        ctx->frame_deadline = now;
+
+    ctx->frame_deadline += frame;
+    return now > ctx->frame_deadline;
+}
@@ -0,0 +1,99 @@
+/* _____ Headless Platform Module -------
+ *
+ * 	No window and no input, for batch runs and the JIT differential check (make jit-diff).
+ * 	Runs the rom in $ROM for $FRAMES frames of emulated time, then prints a hash of
+ * 	every frame presented in that time and exits.
+ */
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define DEFAULT_FRAMES 600
+
+struct DrawingContext {
+    u8 pixels[SCREEN_HEIGHT][SCREEN_WIDTH];
+    u64 hash;     // FNV-1a over the presented frames
+    long frames;  // screen_event_loop calls, one per frame of emulated time
+    long limit;
+};
+
+struct DrawingContext *make_screen(Jpad *jpp) {
+    (void)jpp;
+    struct DrawingContext *context = (struct DrawingContext *) calloc(1, sizeof(struct DrawingContext));
+
+    const char *frames = getenv("FRAMES");
+    context->hash = 0xCBF29CE484222325ULL;
+    context->limit = frames != NULL ? atol(frames) : DEFAULT_FRAMES;
+    return context;
+}
+
+void cleanup_screen(struct DrawingContext *context) {
+    free(context);
+}
+
+void screen_event_loop(struct DrawingContext *context) {
+    if (++context->frames < context->limit) return;
+
+    printf("HASH %016llx\n", (unsigned long long)context->hash);
+    cleanup_screen(context);
+    exit(0);
+}
+
+/* Uses the OS to read the rom named by $ROM, padded to at least the two fixed banks */
+Cartridge load_cartridge() {
+    Cartridge cartridge = {.rom = NULL, .length = 0};
+    const char *path = getenv("ROM");
+
+    FILE *fp = path != NULL ? fopen(path, "rb") : NULL;
+    if (fp == NULL) {
+        perror("Error in opening the file, set ROM");
+        return cartridge;
+    }
+
+    fseek(fp, 0L, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+
+    u8 *pcartridge = (u8 *) calloc(size < 0x8000 ? 0x8000 : size, 1);
+    if (pcartridge == NULL || size <= 0) {
+        perror("Error reading the file");
+        free(pcartridge);
+        fclose(fp);
+        return cartridge;
+    }
+
+    size_t elements_read = fread(pcartridge, 1, size, fp);
+    fclose(fp);
+
+    return (Cartridge) {.rom = pcartridge, .length = elements_read};
+}
+
+/* Shade indices in a buffer that keeps its lines, so unchanged lines are not drawn again */
+FrameTarget begin_frame(struct DrawingContext *ctx) {
+    return (FrameTarget) {
+        .pixels = &ctx->pixels[0][0],
+        .pitch = SCREEN_WIDTH,
+        .format = PIXEL_INDEX,
+        .shades = {0, 1, 2, 3},
+        .persistent = true,
+    };
+}
+
+/* Unchanged frames stay in the buffer, there is nothing to show them on again */
+bool present_frame(struct DrawingContext *ctx, bool changed) {
+    if (!changed) return false;
+
+    const u8 *p = &ctx->pixels[0][0];
+    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+        ctx->hash ^= p[i];
+        ctx->hash *= 0x100000001B3ULL;
+    }
+    return true;
+}
+
+/* Never paced against the wall clock */
+bool frame_behind(struct DrawingContext *ctx) {
+    (void)ctx;
+    return false;
+}
@@ -9,18 +9,48 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 
 typedef uint8_t u8;
 typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
 
 // #define DEBUG // print logs to console
 // #define LOG // Log to an output file "logging.txt"
+// #define BENCH // print emulated instructions per second after ITERATION steps, then the memory read and scanline micro-benchmarks
+// #define IDLE_STATS // print how many polling loop cycles were skipped on exit
+// #define EXIT_STATE // print the CPU registers, clock, IE/IF and a hash of the IO page on exit
+#ifndef ITERATION
 #define ITERATION 999999999
+#endif
+
+// opcode dispatch used by step_cpu, the function pointer table is used when neither is defined
+#define DISPATCH_SWITCH // switch over the opcode with the handlers inlined
+// #define DISPATCH_THREADED // GCC computed goto, takes priority over DISPATCH_SWITCH
+
+// #define LAZY_FLAGS // ALU ops record their operands, Z/N/H/C are only built when read
+// #define ALU_TABLES // ADD/ADC/SUB/SBC/CP/INC/DEC/DAA flags come from tables generated by the Makefile
+// #define BLOCK_CACHE // straight line runs of ROM/WRAM/HRAM code are decoded once and replayed
+// #define JIT // hot blocks are translated to x86-64, needs BLOCK_CACHE, KHEL_JIT=0 turns it off at runtime
 // #define LOG_BUFFER_SIZE 1000
 #define SCREEN_WIDTH  160
 #define SCREEN_HEIGHT  144
 
+// M-cycles of emulated time between screen_event_loop calls, one frame
+#ifndef INPUT_POLL_CYCLES
+#define INPUT_POLL_CYCLES (154 * 114)
+#endif
+
+// frames the PPU only times and does not draw after each one it presents, FRAME_SKIP_AUTO skips while
+// frame_behind says the host is late. KHEL_FRAME_SKIP=N or auto overrides it at runtime
+#ifndef FRAME_SKIP
+#define FRAME_SKIP 0
+#endif
+#define FRAME_SKIP_AUTO (-1)
+#define FRAME_SKIP_AUTO_MAX 4 // longest run of frames auto skip drops
+
 
 struct DrawingContext;
 
@@ -47,8 +77,31 @@ Cartridge load_cartridge(void);
 // screen things
 struct DrawingContext *make_screen();
 void cleanup_screen(struct DrawingContext *context);
+// pumps window and input events, the main loop calls it every INPUT_POLL_CYCLES
 void screen_event_loop(struct DrawingContext *context) ;
-void present_framebuffer(
-    struct DrawingContext *ctx,
-    uint8_t framebuffer[144][160]
-);
\ No newline at end of file
+
+// pixel formats the PPU can draw in, the platform picks one in begin_frame
+typedef enum {
+    PIXEL_INDEX,    // u8, the shade 0 - 3, or whatever value shades[] gives it
+    PIXEL_RGB565,   // u16
+    PIXEL_RGBA8888, // u32, red in the top byte
+} PixelFormat;
+
+// the buffer the next frame is drawn into, owned by the platform
+typedef struct {
+    u8 *pixels;
+    int pitch;          // bytes from one line to the next
+    PixelFormat format;
+    u32 shades[4];      // host pixel of each DMG shade, lightest first
+    // the pixels still hold the last frame after present_frame takes them, unchanged lines are not drawn again.
+    // A target that is not (the desktop's locked texture) stays with the PPU across unchanged frames instead, and
+    // the platform re-presents what it last showed on window events, taking the target back if it holds it
+    bool persistent;
+} FrameTarget;
+
+// the PPU asks for a target before drawing the first line of a frame. At VBlank it offers it back when the frame
+// changed or it holds one, present_frame returns true when it took it, always for a changed frame
+FrameTarget begin_frame(struct DrawingContext *ctx);
+bool present_frame(struct DrawingContext *ctx, bool changed);
+// called at every VBlank under FRAME_SKIP_AUTO, true when the host has fallen behind real time
+bool frame_behind(struct DrawingContext *ctx);
\ No newline at end of file
@@ -4,11 +4,37 @@
 #include "stdlib.h"
 #include <stdbool.h>
 
+#ifdef JIT
+#include <stddef.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef ALU_TABLES
+#include "alu_tables.h"
+#define ALU_INDEX(a, operand, carry) ((a) | (operand) << 8 | (carry) << 16)
+#endif
+
 
 /* Helper Macros */
 #define low(a) (u8)(a & 0x00FF) 
 #define high(a) (u8) ((a & 0xFF00) >> 8)
 
+#ifdef DEBUG
+    #define TRACE_OPCODE(fmt, names, code) printf(fmt, names[code])
+#else
+    #define TRACE_OPCODE(fmt, names, code)
+#endif
+
+/* Computed goto needs GCC labels as values, use the switch everywhere else */
+#if defined(DISPATCH_THREADED) && !defined(__GNUC__)
+    #undef DISPATCH_THREADED
+    #define DISPATCH_SWITCH
+#endif
+
+#if defined(DISPATCH_SWITCH) || defined(DISPATCH_THREADED)
+    #define DISPATCH_INLINE
+#endif
+
 #define ZERO 0x80
 #define SUBTRACT 0x40
 #define HALF_CARRY 0x20
@@ -35,6 +61,12 @@ CPU init_cpu(Memory *p_mem){
         .logs = {0},
         .log_pos = '\0',
         #endif
+        #ifdef BLOCK_CACHE
+        .blocks = calloc(BLOCK_CACHE_SIZE, sizeof(Block)),
+        #endif
+        #ifdef JIT
+        .jit_enabled = true,
+        #endif
     };
 }
 
@@ -43,17 +75,106 @@ CPU init_cpu(Memory *p_mem){
 /* Combines two bytes into a 16 bit word */
 static inline u16 combine_bytes(u8 hi, u8 lo){ return ((u16)hi << 8) | lo;}
 
+/* Lazy flags: ALU helpers only record their operands, F is built when read */
+#ifdef LAZY_FLAGS
+enum { LAZY_NONE, LAZY_ADD, LAZY_SUB, LAZY_AND, LAZY_OR, LAZY_INC, LAZY_DEC, LAZY_ADD_HL };
+
+/* Carry of the pending op, cheaper than building the whole F */
+static inline u8 lazy_carry(const CPU *cpu){
+    u16 a = cpu->lazy.a, b = cpu->lazy.b;
+    u8 c = cpu->lazy.carry_in;
+
+    switch (cpu->lazy.op){
+        case LAZY_ADD: return (a + b + c) > 0xFF;
+        case LAZY_SUB: return a < b + c;
+        case LAZY_AND:
+        case LAZY_OR: return 0;
+        case LAZY_INC:
+        case LAZY_DEC: return (cpu->lazy.keep & CARRY) != 0;
+        case LAZY_ADD_HL: return ((u32)a + b) > 0xFFFF;
+        default: return (cpu->AF.lo & CARRY) != 0;
+    }
+}
+
+static inline u8 lazy_flags(const CPU *cpu){
+    u16 a = cpu->lazy.a, b = cpu->lazy.b;
+    u8 c = cpu->lazy.carry_in;
+    u8 z = (cpu->lazy.res == 0) ? ZERO : 0;
+    u8 cy = lazy_carry(cpu) ? CARRY : 0;
+
+    switch (cpu->lazy.op){
+        #ifdef ALU_TABLES
+        case LAZY_ADD: return alu_add_table[ALU_INDEX(a, b, c)] >> 8;
+        case LAZY_SUB: return alu_sub_table[ALU_INDEX(a, b, c)] >> 8;
+        #else
+        case LAZY_ADD:
+            return z | cy | ((((a & 0x0F) + (b & 0x0F) + c) > 0x0F) ? HALF_CARRY : 0);
+        case LAZY_SUB:
+            return z | SUBTRACT | cy | (((a & 0x0F) < (b & 0x0F) + c) ? HALF_CARRY : 0);
+        #endif
+        case LAZY_AND:
+            return z | HALF_CARRY;
+        case LAZY_OR:
+            return z;
+        case LAZY_INC:
+            return z | cpu->lazy.keep | (((a & 0x0F) == 0x0F) ? HALF_CARRY : 0);
+        case LAZY_DEC:
+            return z | SUBTRACT | cpu->lazy.keep | (((a & 0x0F) == 0x00) ? HALF_CARRY : 0);
+        case LAZY_ADD_HL:
+            return cpu->lazy.keep | cy | ((((a & 0x0FFF) + (b & 0x0FFF)) > 0x0FFF) ? HALF_CARRY : 0);
+        default:
+            return cpu->AF.lo;
+    }
+}
+#endif
+
+/* Folds a pending lazy op into F, anything touching AF.lo directly calls this first */
+static inline void flags_flush(CPU *cpu){
+    #ifdef LAZY_FLAGS
+    if (cpu->lazy.op != LAZY_NONE){
+        cpu->AF.lo = lazy_flags(cpu);
+        cpu->lazy.op = LAZY_NONE;
+    }
+    #else
+    (void)cpu;
+    #endif
+}
+
 /* Sets Specific Flag */
-static inline void set_flag(CPU *cpu, const u8 flag){cpu->AF.lo |= flag;}
+static inline void set_flag(CPU *cpu, const u8 flag){flags_flush(cpu); cpu->AF.lo |= flag;}
 
 /* Resets Specific Flag */
-static inline void unset_flag(CPU *cpu, const u8 flag){cpu->AF.lo &= ~(flag);}
+static inline void unset_flag(CPU *cpu, const u8 flag){flags_flush(cpu); cpu->AF.lo &= ~(flag);}
+
+/* Following flag return status of  corresponding Flag */
+#ifdef LAZY_FLAGS
+static inline int flag_z(const CPU *cpu) {
+    switch (cpu->lazy.op){
+        case LAZY_NONE: return (cpu->AF.lo & ZERO) != 0;
+        case LAZY_ADD_HL: return (cpu->lazy.keep & ZERO) != 0;
+        default: return cpu->lazy.res == 0;
+    }
+}
+static inline int flag_n(const CPU *cpu) {return (lazy_flags(cpu) & SUBTRACT) != 0;}
+static inline int flag_h(const CPU *cpu) {return (lazy_flags(cpu) & HALF_CARRY) != 0;}
+static inline int flag_c(const CPU *cpu) {return lazy_carry(cpu);}
+#else
+static inline int flag_z(const CPU *cpu) {return (cpu->AF.lo & ZERO) != 0;}
+static inline int flag_n(const CPU *cpu) {return (cpu->AF.lo & SUBTRACT) != 0;}
+static inline int flag_h(const CPU *cpu) {return (cpu->AF.lo & HALF_CARRY) != 0;}
+static inline int flag_c(const CPU *cpu) {return (cpu->AF.lo & CARRY) != 0;}
+#endif
 
 /* Next 8 bit value fetched from PC*/
 static inline u8 get_next_8(CPU *cpu){
+    #ifdef BLOCK_CACHE
+    cpu->PC.val ++;
+    return *cpu->operand++;
+    #else
      u8 val = memory_read_8(cpu->p_memory,cpu->PC.val);
      cpu->PC.val ++;
      return val;
+    #endif
 }
 
 /* Next 16 bit value fetched from PC + 1 (little endian)*/
@@ -68,6 +189,12 @@ static inline void add_hl_helper(CPU *cpu, u16 value){
     u32 hl = cpu->HL.val;
     u32 res = hl + value;
 
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_ADD_HL, .a = hl, .b = value, .keep = flag_z(cpu) ? ZERO : 0};
+    cpu->HL.val = (u16)res;
+    return;
+    #endif
+
     if ( ((hl & 0x0FFF) + (value & 0x0FFF)) > 0x0FFF )
         set_flag(cpu, HALF_CARRY);
     else
@@ -90,6 +217,14 @@ static inline void dec_helper(CPU *cpu, u8 *reg){
 
     *reg = result;
 
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_DEC, .a = prev, .res = result, .keep = flag_c(cpu) ? CARRY : 0};
+    return;
+    #elif defined(ALU_TABLES)
+    cpu->AF.lo = (cpu->AF.lo & CARRY) | (alu_dec_table[prev] >> 8);
+    return;
+    #endif
+
     if (result == 0)
         set_flag(cpu, ZERO);
     else
@@ -141,11 +276,6 @@ static inline void ld_m_r_helper(CPU *cpu, u16 dst, u8 src){
     memory_write(cpu->p_memory,dst,src);
 }
 
-/* Following flag return status of  corresponding Flag */
-static inline int flag_z(const CPU *cpu) {return (cpu->AF.lo & ZERO) != 0;}
-static inline int flag_n(const CPU *cpu) {return (cpu->AF.lo & SUBTRACT) != 0;}
-static inline int flag_h(const CPU *cpu) {return (cpu->AF.lo & HALF_CARRY) != 0;}
-static inline int flag_c(const CPU *cpu) {return (cpu->AF.lo & CARRY) != 0;}
 
 static inline void sub_helper(CPU *cpu, const u8 operand){
     u8 prev = cpu->AF.hi;
@@ -153,6 +283,14 @@ static inline void sub_helper(CPU *cpu, const u8 operand){
 
     cpu->AF.hi = new_value;
 
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_SUB, .a = prev, .b = operand, .res = new_value};
+    return;
+    #elif defined(ALU_TABLES)
+    cpu->AF.lo = alu_sub_table[ALU_INDEX(prev, operand, 0)] >> 8;
+    return;
+    #endif
+
     (new_value == 0) ? set_flag(cpu, ZERO): unset_flag(cpu, ZERO);
     set_flag(cpu,SUBTRACT);
     if ((prev & 0x0F) < (operand & 0x0F))
@@ -172,6 +310,14 @@ static inline void add_a_helper(CPU *cpu,  const u8 operand){
 
     cpu->AF.hi = new_value;
 
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_ADD, .a = prev, .b = operand, .res = new_value};
+    return;
+    #elif defined(ALU_TABLES)
+    cpu->AF.lo = alu_add_table[ALU_INDEX(prev, operand, 0)] >> 8;
+    return;
+    #endif
+
     (new_value == 0) ? set_flag(cpu, ZERO): unset_flag(cpu, ZERO);
 
     unset_flag(cpu,SUBTRACT);
@@ -189,6 +335,13 @@ static inline void add_a_helper(CPU *cpu,  const u8 operand){
 
 static inline void and_helper(CPU *cpu , const u8 operand){
     u8 result = cpu->AF.hi & operand;
+
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_AND, .res = result};
+    cpu->AF.hi = result;
+    return;
+    #endif
+
     (result == 0) ? set_flag(cpu, ZERO): unset_flag(cpu, ZERO);
     unset_flag(cpu,SUBTRACT);
     set_flag (cpu, HALF_CARRY); // documented behaviour but not sure TODO
@@ -199,6 +352,12 @@ static inline void and_helper(CPU *cpu , const u8 operand){
 static inline void or_helper(CPU *cpu, const u8 operand){
     u8 result = cpu->AF.hi | operand;
 
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_OR, .res = result};
+    cpu->AF.hi = result;
+    return;
+    #endif
+
     (result == 0) ? set_flag(cpu, ZERO): unset_flag(cpu, ZERO);
     unset_flag(cpu, SUBTRACT);
     unset_flag(cpu, HALF_CARRY);
@@ -209,13 +368,21 @@ static inline void or_helper(CPU *cpu, const u8 operand){
 
 static inline void adc_helper(CPU *cpu, const u8 operand){
     u8 prev = cpu->AF.hi;
-    u8 carry_in = (cpu->AF.lo & CARRY) ? 1 : 0;
+    u8 carry_in = flag_c(cpu) ? 1 : 0;
 
     u16 sum = (u16)prev + (u16)operand + carry_in;
     u8 new_value = (u8)sum;
 
     cpu->AF.hi = new_value;
 
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_ADD, .a = prev, .b = operand, .carry_in = carry_in, .res = new_value};
+    return;
+    #elif defined(ALU_TABLES)
+    cpu->AF.lo = alu_add_table[ALU_INDEX(prev, operand, carry_in)] >> 8;
+    return;
+    #endif
+
     (new_value == 0) ? set_flag(cpu, ZERO) : unset_flag(cpu, ZERO);
 
     unset_flag(cpu, SUBTRACT);
@@ -233,12 +400,20 @@ static inline void adc_helper(CPU *cpu, const u8 operand){
 
 static inline void sbc_helper(CPU *cpu, const u8 operand){
     u8 prev = cpu->AF.hi;
-    u8 carry_in = (cpu->AF.lo & CARRY) ? 1 : 0;
+    u8 carry_in = flag_c(cpu) ? 1 : 0;
 
     u16 diff = (u16)prev - (u16)operand - carry_in;
     u8 new_value = (u8)diff;
 
     cpu->AF.hi = new_value;
+
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_SUB, .a = prev, .b = operand, .carry_in = carry_in, .res = new_value};
+    return;
+    #elif defined(ALU_TABLES)
+    cpu->AF.lo = alu_sub_table[ALU_INDEX(prev, operand, carry_in)] >> 8;
+    return;
+    #endif
     (new_value == 0) ? set_flag(cpu, ZERO) : unset_flag(cpu, ZERO);
 
     set_flag(cpu, SUBTRACT);
@@ -255,6 +430,12 @@ static inline void sbc_helper(CPU *cpu, const u8 operand){
 static inline void xor_helper(CPU *cpu , const u8 operand){
     u8 result = cpu->AF.hi ^ operand;
 
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_OR, .res = result};
+    cpu->AF.hi = result;
+    return;
+    #endif
+
     if (result == 0)
         set_flag(cpu,ZERO);
     else
@@ -270,6 +451,14 @@ static inline void cp_helper(CPU *cpu, const u8 operand){
     u8 prev = cpu->AF.hi;
     u8 result = prev - operand;
 
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_SUB, .a = prev, .b = operand, .res = result};
+    return;
+    #elif defined(ALU_TABLES)
+    cpu->AF.lo = alu_sub_table[ALU_INDEX(prev, operand, 0)] >> 8;
+    return;
+    #endif
+
     (result == 0) ? set_flag(cpu, ZERO) : unset_flag(cpu, ZERO);
 
     set_flag(cpu, SUBTRACT);
@@ -296,7 +485,7 @@ static inline void jr_helper(CPU *cpu){
          Each Opcode has its own associated Function (inline)
 */
 
-static inline void nop(){/* do nothing*/}
+static inline void nop(CPU *cpu){(void)cpu; /* do nothing*/}
 
 // jp ins
 static inline void jp_a16( CPU *cpu){   cpu -> PC.val =  get_next_16(cpu);}
@@ -439,6 +628,14 @@ static inline void add_hl_sp(CPU *cpu){ add_hl_helper(cpu, cpu->SP.val);    }
 
 static inline void daa(CPU *cpu){
     /* This one is a weird and confusing one*/
+    #ifdef ALU_TABLES
+    flags_flush(cpu);
+    u16 r = alu_daa_table[cpu->AF.hi | (flag_n(cpu) << 8) | (flag_h(cpu) << 9) | (flag_c(cpu) << 10)];
+    cpu->AF.hi = r & 0xFF;
+    cpu->AF.lo = r >> 8;
+    return;
+    #endif
+
     u8 a = cpu->AF.hi;
     u8 adjust = 0;
     u8 carry = 0;
@@ -503,90 +700,20 @@ static inline void rst_7(CPU *cpu){ rst_helper(cpu,0x38);}
 
 
 // INC instructions
-static inline void inc_a(CPU *cpu)
-{
-    u8 val = cpu->AF.hi;
-    u8 res = val + 1;
-
-    cpu->AF.lo &= ~(ZERO | SUBTRACT | HALF_CARRY);
-
-    if (res == 0)
-        cpu->AF.lo |= ZERO;
-
-    if ((val & 0x0F) == 0x0F)
-        cpu->AF.lo |= HALF_CARRY;
-    cpu->AF.lo &= 0xF0;
-    cpu->AF.hi = res;
-}
-
-static inline void inc_c(CPU *cpu)
-{
-    u8 val = cpu->BC.lo;
-    u8 res = val + 1;
-    cpu->AF.lo &= ~(ZERO | SUBTRACT | HALF_CARRY);
-
-    if (res == 0)
-        cpu->AF.lo |= ZERO;
-
-    if ((val & 0x0F) == 0x0F)
-        cpu->AF.lo |= HALF_CARRY;
-    cpu->AF.lo &= 0xF0;
-    cpu->BC.lo = res;
-}
-
-static inline void inc_e(CPU *cpu)
-
-{
-    u8 val = cpu->DE.lo;
-    u8 res = val + 1;
-
-    cpu->AF.lo &= ~(ZERO | SUBTRACT | HALF_CARRY);
-
-    if (res == 0)
-        cpu->AF.lo |= ZERO;
-
-    if ((val & 0x0F) == 0x0F)
-        cpu->AF.lo |= HALF_CARRY;
-    cpu->AF.lo &= 0xF0;
-    cpu->DE.lo = res;
-}
-
-static inline void inc_l(CPU *cpu)
-{
-    u8 val = cpu->HL.lo;
-    u8 res = val + 1;
-
-    cpu->AF.lo &= ~(ZERO | SUBTRACT | HALF_CARRY);
-
-    if (res == 0)
-        cpu->AF.lo |= ZERO;
-
-    if ((val & 0x0F) == 0x0F)
-        cpu->AF.lo |= HALF_CARRY;
-    cpu->AF.lo &= 0xF0;
-    cpu->HL.lo = res;
-}
-
-static inline void inc_b(CPU *cpu)
+static inline void inc_helper(CPU *cpu, u8 *reg)
 {
-    u8 val = cpu->BC.hi;
+    u8 val = *reg;
     u8 res = val + 1;
 
-    cpu->AF.lo &= ~(ZERO | SUBTRACT | HALF_CARRY);
-
-    if (res == 0)
-        cpu->AF.lo |= ZERO;
-
-    if ((val & 0x0F) == 0x0F)
-        cpu->AF.lo |= HALF_CARRY;
-    cpu->AF.lo &= 0xF0;
-    cpu->BC.hi = res;
-}
-
-static inline void inc_d(CPU *cpu)
-{
-    u8 val = cpu->DE.hi;
-    u8 res = val + 1;
+    #ifdef LAZY_FLAGS
+    cpu->lazy = (LazyFlags){.op = LAZY_INC, .a = val, .res = res, .keep = flag_c(cpu) ? CARRY : 0};
+    *reg = res;
+    return;
+    #elif defined(ALU_TABLES)
+    cpu->AF.lo = (cpu->AF.lo & CARRY) | (alu_inc_table[val] >> 8);
+    *reg = res;
+    return;
+    #endif
 
     cpu->AF.lo &= ~(ZERO | SUBTRACT | HALF_CARRY);
 
@@ -595,42 +722,25 @@ static inline void inc_d(CPU *cpu)
 
     if ((val & 0x0F) == 0x0F)
         cpu->AF.lo |= HALF_CARRY;
-
     cpu->AF.lo &= 0xF0;
-    cpu->DE.hi = res;
+    *reg = res;
 }
 
-static inline void inc_h(CPU *cpu)
-{
-    u8 val = cpu->HL.hi;
-    u8 res = val + 1;
-
-    cpu->AF.lo &= ~(ZERO | SUBTRACT | HALF_CARRY);
-
-    if (res == 0)
-        cpu->AF.lo |= ZERO;
-    if ((val & 0x0F) == 0x0F)
-        cpu->AF.lo |= HALF_CARRY;
-    cpu->AF.lo &= 0xF0;
-    cpu->HL.hi = res;
-}
+static inline void inc_a(CPU *cpu){ inc_helper(cpu, &cpu->AF.hi); }
+static inline void inc_b(CPU *cpu){ inc_helper(cpu, &cpu->BC.hi); }
+static inline void inc_c(CPU *cpu){ inc_helper(cpu, &cpu->BC.lo); }
+static inline void inc_d(CPU *cpu){ inc_helper(cpu, &cpu->DE.hi); }
+static inline void inc_e(CPU *cpu){ inc_helper(cpu, &cpu->DE.lo); }
+static inline void inc_h(CPU *cpu){ inc_helper(cpu, &cpu->HL.hi); }
+static inline void inc_l(CPU *cpu){ inc_helper(cpu, &cpu->HL.lo); }
 
 static inline void inc_m(CPU *cpu)
 {
     u8 val = memory_read_8(cpu->p_memory, cpu->HL.val);
-    u8 res = val + 1;
-
-    cpu->AF.lo &= ~(ZERO | SUBTRACT | HALF_CARRY);
-    if (res == 0)
-        cpu->AF.lo |= ZERO;
-    if ((val & 0x0F) == 0x0F)
-        cpu->AF.lo |= HALF_CARRY;
-
-    cpu->AF.lo &= 0xF0;
-    memory_write(cpu->p_memory, cpu->HL.val, res);
+    inc_helper(cpu, &val);
+    memory_write(cpu->p_memory, cpu->HL.val, val);
 }
 
-// TODO: make a helper function for inc and dec 
 
 // RET instructions
 static inline void ret(CPU *cpu){
@@ -757,13 +867,13 @@ static inline void ld_a_h(CPU *cpu){   ld_r_r_helper(&cpu->AF.hi, &cpu->HL.hi);}
 static inline void ld_a_l(CPU *cpu){   ld_r_r_helper( &cpu->AF.hi, &cpu->HL.lo);}
 static inline void ld_a_a(CPU *cpu){   ld_r_r_helper(&cpu->AF.hi, &cpu->AF.hi);}
 
-static inline void ld_b_m(CPU *cpu){   ld_r_r_helper( &cpu->BC.hi, get_address(cpu->p_memory, cpu->HL.val,false));}
-static inline void ld_d_m(CPU *cpu){   ld_r_r_helper(&cpu->DE.hi, get_address(cpu->p_memory, cpu->HL.val,false));}
-static inline void ld_h_m(CPU *cpu){   ld_r_r_helper( &cpu->HL.hi, get_address(cpu->p_memory, cpu->HL.val,false));}
-static inline void ld_c_m(CPU *cpu){   ld_r_r_helper( &cpu->BC.lo, get_address(cpu->p_memory, cpu->HL.val,false));}
-static inline void ld_e_m(CPU *cpu){   ld_r_r_helper(&cpu->DE.lo, get_address(cpu->p_memory, cpu->HL.val,false));}
-static inline void ld_l_m(CPU *cpu){   ld_r_r_helper(&cpu->HL.lo, get_address(cpu->p_memory, cpu->HL.val,false));}
-static inline void ld_a_m(CPU *cpu){   ld_r_r_helper(&cpu->AF.hi, get_address(cpu->p_memory, cpu->HL.val,false));}
+static inline void ld_b_m(CPU *cpu){   cpu->BC.hi = memory_read_8(cpu->p_memory, cpu->HL.val);}
+static inline void ld_d_m(CPU *cpu){   cpu->DE.hi = memory_read_8(cpu->p_memory, cpu->HL.val);}
+static inline void ld_h_m(CPU *cpu){   cpu->HL.hi = memory_read_8(cpu->p_memory, cpu->HL.val);}
+static inline void ld_c_m(CPU *cpu){   cpu->BC.lo = memory_read_8(cpu->p_memory, cpu->HL.val);}
+static inline void ld_e_m(CPU *cpu){   cpu->DE.lo = memory_read_8(cpu->p_memory, cpu->HL.val);}
+static inline void ld_l_m(CPU *cpu){   cpu->HL.lo = memory_read_8(cpu->p_memory, cpu->HL.val);}
+static inline void ld_a_m(CPU *cpu){   cpu->AF.hi = memory_read_8(cpu->p_memory, cpu->HL.val);}
 
 static inline void ld_m_b(CPU *cpu){    ld_m_r_helper(cpu, cpu->HL.val,cpu->BC.hi);}
 static inline void ld_m_a(CPU *cpu){    ld_m_r_helper(cpu, cpu->HL.val,cpu->AF.hi);}
@@ -997,7 +1107,12 @@ static inline void dec_l(CPU *cpu){ dec_helper(cpu,&cpu->HL.lo);}
 static inline void dec_a(CPU *cpu){ dec_helper(cpu,&cpu->AF.hi);}
 static inline void dec_b(CPU *cpu){ dec_helper(cpu,&cpu->BC.hi);}
 static inline void dec_d(CPU *cpu){ dec_helper(cpu,&cpu->DE.hi);}
-static inline void dec_m(CPU *cpu){ dec_helper(cpu,get_address(cpu->p_memory,cpu->HL.val,true));}
+static inline void dec_m(CPU *cpu)
+{
+    u8 val = memory_read_8(cpu->p_memory, cpu->HL.val);
+    dec_helper(cpu, &val);
+    memory_write(cpu->p_memory, cpu->HL.val, val);
+}
 static inline void dec_h(CPU *cpu){ dec_helper(cpu,&cpu->HL.hi);}
 
 // stack operations
@@ -1017,6 +1132,7 @@ static inline void push_hl(CPU *cpu){
 }
 
 static inline void push_af(CPU *cpu){
+    flags_flush(cpu);
     push(cpu, cpu->AF.hi);
     push(cpu, cpu->AF.lo &  0xF0);
 }
@@ -1037,6 +1153,7 @@ static inline void pop_hl(CPU *cpu){
 }
 
 static inline void pop_af(CPU *cpu){
+    flags_flush(cpu);
     cpu->AF.lo = pop(cpu);
     cpu->AF.hi = pop(cpu);
     cpu->AF.lo &= 0xF0;
@@ -1101,6 +1218,7 @@ void rlca(CPU *cpu){
 }
 
 static inline void rla(CPU *cpu){
+    flags_flush(cpu);
     u8 a = cpu->AF.hi;
     u8 old_carry = (cpu->AF.lo & CARRY) ? 1 : 0;
     u8 new_carry = (a & 0x80) >> 7;
@@ -1223,6 +1341,7 @@ static inline void sla_helper(CPU *cpu, u8 *val) {
     *val <<= 1;
 
     // flags
+    flags_flush(cpu);
     cpu->AF.lo &= ~(ZERO | SUBTRACT | HALF_CARRY | CARRY); // clear all first
     if(*val == 0) cpu->AF.lo |= ZERO;
     cpu->AF.lo |= (original & 0x80) ? CARRY : 0;
@@ -1321,7 +1440,12 @@ static inline void srl_e(CPU *cpu){ srl_helper(cpu, &cpu->DE.lo);}
 static inline void srl_h(CPU *cpu){ srl_helper(cpu, &cpu->HL.hi);}
 static inline void srl_l(CPU *cpu){ srl_helper(cpu, &cpu->HL.lo);}
 static inline void srl_a(CPU *cpu){ srl_helper(cpu, &cpu->AF.hi);}
-static inline void srl_m(CPU *cpu){ srl_helper(cpu, get_address(cpu->p_memory, cpu->HL.val,true));}
+static inline void srl_m(CPU *cpu)
+{
+    u8 val = memory_read_8(cpu->p_memory, cpu->HL.val);
+    srl_helper(cpu, &val);
+    memory_write(cpu->p_memory, cpu->HL.val, val);
+}
 
 // rr
 static inline void rr_b(CPU *cpu){ rr_helper(cpu, &cpu->BC.hi);}
@@ -1331,7 +1455,12 @@ static inline void rr_e(CPU *cpu){ rr_helper(cpu, &cpu->DE.lo);}
 static inline void rr_h(CPU *cpu){ rr_helper(cpu, &cpu->HL.hi);}
 static inline void rr_l(CPU *cpu){ rr_helper(cpu, &cpu->HL.lo);}
 static inline void rr_a(CPU *cpu){ rr_helper(cpu, &cpu->AF.hi);}
-static inline void rr_m(CPU *cpu){ rr_helper(cpu, get_address(cpu->p_memory, cpu->HL.val,true));}
+static inline void rr_m(CPU *cpu)
+{
+    u8 val = memory_read_8(cpu->p_memory, cpu->HL.val);
+    rr_helper(cpu, &val);
+    memory_write(cpu->p_memory, cpu->HL.val, val);
+}
 
 // bit 
 static inline void bit_0_b(CPU *cpu){ bit_helper(cpu, cpu->BC.hi, 0); }
@@ -1758,326 +1887,42 @@ static inline void rlc_hl(CPU *cpu)
 }
 
 
-static Opcode prefixed_opcodes[256]={
-    [0x08] = {"RRC B",    2, &rrc_b},
-    [0x09] = {"RRC C",    2, &rrc_c},
-    [0x0A] = {"RRC D",    2, &rrc_d},
-    [0x0B] = {"RRC E",    2, &rrc_e},
-    [0x0C] = {"RRC H",    2, &rrc_h},
-    [0x0D] = {"RRC L",    2, &rrc_l},
-    [0x0E] = {"RRC (HL)", 4, &rrc_hl},
-    [0x0F] = {"RRC A",    2, &rrc_a},
-
-    [0x38] = {"SRL B", 2, &srl_b},
-    [0x39] = {"SRL C", 2, &srl_c},
-    [0x3A] = {"SRL D", 2, &srl_d},
-    [0x3B] = {"SRL E", 2, &srl_e},
-    [0x3C] = {"SRL H", 2, &srl_h},
-    [0x3D] = {"SRL L", 2, &srl_l},
-    [0x3E] = {"SRL (HL)", 4, &srl_m},
-    [0x3F] = {"SRL A", 2, &srl_a},
-
-
-    [0x18] = {"RR B", 2, &rr_b},
-    [0x19] = {"RR C", 2, &rr_c},
-    [0x1A] = {"RR D", 2, &rr_d},
-    [0x1B] = {"RR E", 2, &rr_e},
-    [0x1C] = {"RR H", 2, &rr_h},
-    [0x1D] = {"RR L", 2, &rr_l},
-    [0x1E] = {"RR (HL)", 4, &rr_m},
-    [0x1F] = {"RR a", 2, &rr_a},
-
-    [0x10] = {"RL B",    2, &rl_b},
-    [0x11] = {"RL C",    2, &rl_c},
-    [0x12] = {"RL D",    2, &rl_d},
-    [0x13] = {"RL E",    2, &rl_e},
-    [0x14] = {"RL H",    2, &rl_h},
-    [0x15] = {"RL L",    2, &rl_l},
-    [0x16] = {"RL (HL)", 4, &rl_hl},
-    [0x17] = {"RL A",    2, &rl_a},
-
-    [0x28] = {"SRA B",    2, &sra_b},
-    [0x29] = {"SRA C",    2, &sra_c},
-    [0x2A] = {"SRA D",    2, &sra_d},
-    [0x2B] = {"SRA E",    2, &sra_e},
-    [0x2C] = {"SRA H",    2, &sra_h},
-    [0x2D] = {"SRA L",    2, &sra_l},
-    [0x2E] = {"SRA (HL)", 4, &sra_hl},
-    [0x2F] = {"SRA A",    2, &sra_a},
-
-
-
-    [0x40] = {"BIT 0,B", 2, &bit_0_b},
-    [0x41] = {"BIT 0,C", 2, &bit_0_c},
-    [0x42] = {"BIT 0,D", 2, &bit_0_d},
-    [0x43] = {"BIT 0,E", 2, &bit_0_e},
-    [0x44] = {"BIT 0,H", 2, &bit_0_h},
-    [0x45] = {"BIT 0,L", 2, &bit_0_l},
-    [0x46] = {"BIT 0,(HL)", 3, &bit_0_hl},
-    [0x47] = {"BIT 0,A", 2, &bit_0_a},
-
-    [0x48] = {"BIT 1,B", 2, &bit_1_b},
-    [0x49] = {"BIT 1,C", 2, &bit_1_c},
-    [0x4A] = {"BIT 1,D", 2, &bit_1_d},
-    [0x4B] = {"BIT 1,E", 2, &bit_1_e},
-    [0x4C] = {"BIT 1,H", 2, &bit_1_h},
-    [0x4D] = {"BIT 1,L", 2, &bit_1_l},
-    [0x4E] = {"BIT 1,(HL)", 3, &bit_1_hl},
-    [0x4F] = {"BIT 1,A", 2, &bit_1_a},
-
-    [0x50] = {"BIT 2,B", 2, &bit_2_b},
-    [0x51] = {"BIT 2,C", 2, &bit_2_c},
-    [0x52] = {"BIT 2,D", 2, &bit_2_d},
-    [0x53] = {"BIT 2,E", 2, &bit_2_e},
-    [0x54] = {"BIT 2,H", 2, &bit_2_h},
-    [0x55] = {"BIT 2,L", 2, &bit_2_l},
-    [0x56] = {"BIT 2,(HL)", 3, &bit_2_hl},
-    [0x57] = {"BIT 2,A", 2, &bit_2_a},
-
-    [0x58] = {"BIT 3,B", 2, &bit_3_b},
-    [0x59] = {"BIT 3,C", 2, &bit_3_c},
-    [0x5A] = {"BIT 3,D", 2, &bit_3_d},
-    [0x5B] = {"BIT 3,E", 2, &bit_3_e},
-    [0x5C] = {"BIT 3,H", 2, &bit_3_h},
-    [0x5D] = {"BIT 3,L", 2, &bit_3_l},
-    [0x5E] = {"BIT 3,(HL)", 3, &bit_3_hl},
-    [0x5F] = {"BIT 3,A", 2, &bit_3_a},
-
-    [0x60] = {"BIT 4,B", 2, &bit_4_b},
-    [0x61] = {"BIT 4,C", 2, &bit_4_c},
-    [0x62] = {"BIT 4,D", 2, &bit_4_d},
-    [0x63] = {"BIT 4,E", 2, &bit_4_e},
-    [0x64] = {"BIT 4,H", 2, &bit_4_h},
-    [0x65] = {"BIT 4,L", 2, &bit_4_l},
-    [0x66] = {"BIT 4,(HL)", 3, &bit_4_hl},
-    [0x67] = {"BIT 4,A", 2, &bit_4_a},
-
-    [0x68] = {"BIT 5,B", 2, &bit_5_b},
-    [0x69] = {"BIT 5,C", 2, &bit_5_c},
-    [0x6A] = {"BIT 5,D", 2, &bit_5_d},
-    [0x6B] = {"BIT 5,E", 2, &bit_5_e},
-    [0x6C] = {"BIT 5,H", 2, &bit_5_h},
-    [0x6D] = {"BIT 5,L", 2, &bit_5_l},
-    [0x6E] = {"BIT 5,(HL)", 3, &bit_5_hl},
-    [0x6F] = {"BIT 5,A", 2, &bit_5_a},
-
-    [0x70] = {"BIT 6,B", 2, &bit_6_b},
-    [0x71] = {"BIT 6,C", 2, &bit_6_c},
-    [0x72] = {"BIT 6,D", 2, &bit_6_d},
-    [0x73] = {"BIT 6,E", 2, &bit_6_e},
-    [0x74] = {"BIT 6,H", 2, &bit_6_h},
-    [0x75] = {"BIT 6,L", 2, &bit_6_l},
-    [0x76] = {"BIT 6,(HL)", 3, &bit_6_hl},
-    [0x77] = {"BIT 6,A", 2, &bit_6_a},
-
-    [0x78] = {"BIT 7,B", 2, &bit_7_b},
-    [0x79] = {"BIT 7,C", 2, &bit_7_c},
-    [0x7A] = {"BIT 7,D", 2, &bit_7_d},
-    [0x7B] = {"BIT 7,E", 2, &bit_7_e},
-    [0x7C] = {"BIT 7,H", 2, &bit_7_h},
-    [0x7D] = {"BIT 7,L", 2, &bit_7_l},
-    [0x7E] = {"BIT 7,(HL)", 3, &bit_7_hl},
-    [0x7F] = {"BIT 7,A", 2, &bit_7_a},
-
-    // RES 0
-    [0x80] = {"RES 0,B", 2, &res_0_b},
-    [0x81] = {"RES 0,C", 2, &res_0_c},
-    [0x82] = {"RES 0,D", 2, &res_0_d},
-    [0x83] = {"RES 0,E", 2, &res_0_e},
-    [0x84] = {"RES 0,H", 2, &res_0_h},
-    [0x85] = {"RES 0,L", 2, &res_0_l},
-    [0x86] = {"RES 0,(HL)", 4, &res_0_hl},
-    [0x87] = {"RES 0,A", 2, &res_0_a},
-
-    // RES 1
-    [0x88] = {"RES 1,B", 2, &res_1_b},
-    [0x89] = {"RES 1,C", 2, &res_1_c},
-    [0x8A] = {"RES 1,D", 2, &res_1_d},
-    [0x8B] = {"RES 1,E", 2, &res_1_e},
-    [0x8C] = {"RES 1,H", 2, &res_1_h},
-    [0x8D] = {"RES 1,L", 2, &res_1_l},
-    [0x8E] = {"RES 1,(HL)", 4, &res_1_hl},
-    [0x8F] = {"RES 1,A", 2, &res_1_a},
-
-    // RES 2
-    [0x90] = {"RES 2,B", 2, &res_2_b},
-    [0x91] = {"RES 2,C", 2, &res_2_c},
-    [0x92] = {"RES 2,D", 2, &res_2_d},
-    [0x93] = {"RES 2,E", 2, &res_2_e},
-    [0x94] = {"RES 2,H", 2, &res_2_h},
-    [0x95] = {"RES 2,L", 2, &res_2_l},
-    [0x96] = {"RES 2,(HL)", 4, &res_2_hl},
-    [0x97] = {"RES 2,A", 2, &res_2_a},
-
-    // RES 3
-    [0x98] = {"RES 3,B", 2, &res_3_b},
-    [0x99] = {"RES 3,C", 2, &res_3_c},
-    [0x9A] = {"RES 3,D", 2, &res_3_d},
-    [0x9B] = {"RES 3,E", 2, &res_3_e},
-    [0x9C] = {"RES 3,H", 2, &res_3_h},
-    [0x9D] = {"RES 3,L", 2, &res_3_l},
-    [0x9E] = {"RES 3,(HL)", 4, &res_3_hl},
-    [0x9F] = {"RES 3,A", 2, &res_3_a},
-
-    // RES 4
-    [0xA0] = {"RES 4,B", 2, &res_4_b},
-    [0xA1] = {"RES 4,C", 2, &res_4_c},
-    [0xA2] = {"RES 4,D", 2, &res_4_d},
-    [0xA3] = {"RES 4,E", 2, &res_4_e},
-    [0xA4] = {"RES 4,H", 2, &res_4_h},
-    [0xA5] = {"RES 4,L", 2, &res_4_l},
-    [0xA6] = {"RES 4,(HL)", 4, &res_4_hl},
-    [0xA7] = {"RES 4,A", 2, &res_4_a},
-
-    // RES 5
-    [0xA8] = {"RES 5,B", 2, &res_5_b},
-    [0xA9] = {"RES 5,C", 2, &res_5_c},
-    [0xAA] = {"RES 5,D", 2, &res_5_d},
-    [0xAB] = {"RES 5,E", 2, &res_5_e},
-    [0xAC] = {"RES 5,H", 2, &res_5_h},
-    [0xAD] = {"RES 5,L", 2, &res_5_l},
-    [0xAE] = {"RES 5,(HL)", 4, &res_5_hl},
-    [0xAF] = {"RES 5,A", 2, &res_5_a},
-
-    // RES 6
-    [0xB0] = {"RES 6,B", 2, &res_6_b},
-    [0xB1] = {"RES 6,C", 2, &res_6_c},
-    [0xB2] = {"RES 6,D", 2, &res_6_d},
-    [0xB3] = {"RES 6,E", 2, &res_6_e},
-    [0xB4] = {"RES 6,H", 2, &res_6_h},
-    [0xB5] = {"RES 6,L", 2, &res_6_l},
-    [0xB6] = {"RES 6,(HL)", 4, &res_6_hl},
-    [0xB7] = {"RES 6,A", 2, &res_6_a},
-
-    // RES 7
-    [0xB8] = {"RES 7,B", 2, &res_7_b},
-    [0xB9] = {"RES 7,C", 2, &res_7_c},
-    [0xBA] = {"RES 7,D", 2, &res_7_d},
-    [0xBB] = {"RES 7,E", 2, &res_7_e},
-    [0xBC] = {"RES 7,H", 2, &res_7_h},
-    [0xBD] = {"RES 7,L", 2, &res_7_l},
-    [0xBE] = {"RES 7,(HL)", 4, &res_7_hl},
-    [0xBF] = {"RES 7,A", 2, &res_7_a},
-
-    // SET 0
-    [0xC0] = {"SET 0,B", 2, &set_0_b},
-    [0xC1] = {"SET 0,C", 2, &set_0_c},
-    [0xC2] = {"SET 0,D", 2, &set_0_d},
-    [0xC3] = {"SET 0,E", 2, &set_0_e},
-    [0xC4] = {"SET 0,H", 2, &set_0_h},
-    [0xC5] = {"SET 0,L", 2, &set_0_l},
-    [0xC6] = {"SET 0,(HL)", 4, &set_0_hl},
-    [0xC7] = {"SET 0,A", 2, &set_0_a},
-
-    // SET 1
-    [0xC8] = {"SET 1,B", 2, &set_1_b},
-    [0xC9] = {"SET 1,C", 2, &set_1_c},
-    [0xCA] = {"SET 1,D", 2, &set_1_d},
-    [0xCB] = {"SET 1,E", 2, &set_1_e},
-    [0xCC] = {"SET 1,H", 2, &set_1_h},
-    [0xCD] = {"SET 1,L", 2, &set_1_l},
-    [0xCE] = {"SET 1,(HL)", 4, &set_1_hl},
-    [0xCF] = {"SET 1,A", 2, &set_1_a},
-
-    // SET 2
-    [0xD0] = {"SET 2,B", 2, &set_2_b},
-    [0xD1] = {"SET 2,C", 2, &set_2_c},
-    [0xD2] = {"SET 2,D", 2, &set_2_d},
-    [0xD3] = {"SET 2,E", 2, &set_2_e},
-    [0xD4] = {"SET 2,H", 2, &set_2_h},
-    [0xD5] = {"SET 2,L", 2, &set_2_l},
-    [0xD6] = {"SET 2,(HL)", 4, &set_2_hl},
-    [0xD7] = {"SET 2,A", 2, &set_2_a},
-
-    // SET 3
-    [0xD8] = {"SET 3,B", 2, &set_3_b},
-    [0xD9] = {"SET 3,C", 2, &set_3_c},
-    [0xDA] = {"SET 3,D", 2, &set_3_d},
-    [0xDB] = {"SET 3,E", 2, &set_3_e},
-    [0xDC] = {"SET 3,H", 2, &set_3_h},
-    [0xDD] = {"SET 3,L", 2, &set_3_l},
-    [0xDE] = {"SET 3,(HL)",4, &set_3_hl},
-    [0xDF] = {"SET 3,A", 2, &set_3_a},
-
-    // SET 4
-    [0xE0] = {"SET 4,B", 2, &set_4_b},
-    [0xE1] = {"SET 4,C", 2, &set_4_c},
-    [0xE2] = {"SET 4,D", 2, &set_4_d},
-    [0xE3] = {"SET 4,E", 2, &set_4_e},
-    [0xE4] = {"SET 4,H", 2, &set_4_h},
-    [0xE5] = {"SET 4,L", 2, &set_4_l},
-    [0xE6] = {"SET 4,(HL)", 4, &set_4_hl},
-    [0xE7] = {"SET 4,A", 2, &set_4_a},
-
-    // SET 5
-    [0xE8] = {"SET 5,B", 2, &set_5_b},
-    [0xE9] = {"SET 5,C", 2, &set_5_c},
-    [0xEA] = {"SET 5,D", 2, &set_5_d},
-    [0xEB] = {"SET 5,E", 2, &set_5_e},
-    [0xEC] = {"SET 5,H", 2, &set_5_h},
-    [0xED] = {"SET 5,L", 2, &set_5_l},
-    [0xEE] = {"SET 5,(HL)", 4, &set_5_hl},
-    [0xEF] = {"SET 5,A", 2, &set_5_a},
-
-    // SET 6
-    [0xF0] = {"SET 6,B", 2, &set_6_b},
-    [0xF1] = {"SET 6,C", 2, &set_6_c},
-    [0xF2] = {"SET 6,D", 2, &set_6_d},
-    [0xF3] = {"SET 6,E", 2, &set_6_e},
-    [0xF4] = {"SET 6,H", 2, &set_6_h},
-    [0xF5] = {"SET 6,L", 2, &set_6_l},
-    [0xF6] = {"SET 6,(HL)", 4, &set_6_hl},
-    [0xF7] = {"SET 6,A", 2, &set_6_a},
-
-    // SET 7
-    [0xF8] = {"SET 7,B", 2, &set_7_b},
-    [0xF9] = {"SET 7,C", 2, &set_7_c},
-    [0xFA] = {"SET 7,D", 2, &set_7_d},
-    [0xFB] = {"SET 7,E", 2, &set_7_e},
-    [0xFC] = {"SET 7,H", 2, &set_7_h},
-    [0xFD] = {"SET 7,L", 2, &set_7_l},
-    [0xFE] = {"SET 7,(HL)", 4, &set_7_hl},
-    [0xFF] = {"SET 7,A", 2, &set_7_a},
-
-
-    [0x37] = {"SWAP A", 2, &swap_a},
-    [0x30] = {"SWAP B", 2, &swap_b},
-    [0x31] = {"SWAP C", 2, &swap_c},
-    [0x32] = {"SWAP D", 2, &swap_d},
-    [0x33] = {"SWAP E", 2, &swap_e},
-    [0x34] = {"SWAP H", 2, &swap_h},
-    [0x35] = {"SWAP L", 2, &swap_l},
-    [0x36] = {"SWAP (HL)", 4, &swap_hl},
-
-    [0x20] = {"SLA B", 2, &sla_b},
-    [0x21] = {"SLA C", 2, &sla_c},
-    [0x22] = {"SLA D", 2, &sla_d},
-    [0x23] = {"SLA E", 2, &sla_e},
-    [0x24] = {"SLA H", 2, &sla_h},
-    [0x25] = {"SLA L", 2, &sla_l},
-    [0x26] = {"SLA (HL)", 4, &sla_hl}, 
-    [0x27] = {"SLA A", 2, &sla_a},
-
-    [0x00] = {"RLC B",    2, &rlc_b},
-    [0x01] = {"RLC C",    2, &rlc_c},
-    [0x02] = {"RLC D",    2, &rlc_d},
-    [0x03] = {"RLC E",    2, &rlc_e},
-    [0x04] = {"RLC H",    2, &rlc_h},
-    [0x05] = {"RLC L",    2, &rlc_l},
-    [0x06] = {"RLC (HL)", 4, &rlc_hl},
-    [0x07] = {"RLC A",    2, &rlc_a},
+#ifdef DEBUG
+/* Mnemonics are only read by the DEBUG trace, so they stay out of the dispatch tables */
+static const char *const prefixed_opcode_names[256] = {
+    #define CB_OPCODE(code, name, cyc, method) [code] = name,
+    #include "opcode_table.h"
+};
+#endif
+
+#if !defined(DISPATCH_INLINE) || defined(JIT)
+static const opcode_method prefixed_opcode_methods[256] = {
+    #define CB_OPCODE(code, name, cyc, method) [code] = &method,
+    #include "opcode_table.h"
+};
+
+static const u8 prefixed_opcode_cycles[256] = {
+    #define CB_OPCODE(code, name, cyc, method) [code] = cyc,
+    #include "opcode_table.h"
 };
+#endif
 
 static inline void cb_helper(CPU *cpu){
     u8 micro_ins = get_next_8(cpu);
-    Opcode prefixed_opcode = prefixed_opcodes[micro_ins];
 
-    if(prefixed_opcode.opcode_method != NULL){
-        #ifdef DEBUG
-            printf("[Executing Prefixed opcode: %s]\n", prefixed_opcode.name);
-        #endif
-        prefixed_opcode.opcode_method(cpu);
-        cpu->cycles += prefixed_opcode.cycles;
+    #ifdef DISPATCH_INLINE
+    switch (micro_ins){
+        #define CB_OPCODE(code, name, cyc, method) \
+            case code: TRACE_OPCODE("[Executing Prefixed opcode: %s]\n", prefixed_opcode_names, code); method(cpu); cpu->cycles += cyc; return;
+        #include "opcode_table.h"
+    }
+    #else
+    opcode_method method = prefixed_opcode_methods[micro_ins];
+
+    if(method != NULL){
+        TRACE_OPCODE("[Executing Prefixed opcode: %s]\n", prefixed_opcode_names, micro_ins);
+        method(cpu);
+        cpu->cycles += prefixed_opcode_cycles[micro_ins];
     }
     else{
         
@@ -2085,6 +1930,7 @@ static inline void cb_helper(CPU *cpu){
         printf("[NOT IMPLEMENTED PREFIXED OPCODE: %x]\n",micro_ins);
         exit(0);
     }
+    #endif
 }
 
 // misc instructions
@@ -2108,303 +1954,473 @@ static inline void ccf(CPU *cpu)
 }
 
 
-static Opcode opcodes[256]= {
-    [0xCB] = {"CB Prefixed", 0, &cb_helper},
+#ifdef DEBUG
+static const char *const opcode_names[256] = {
+    #define OPCODE(code, name, cyc, method) [code] = name,
+    #include "opcode_table.h"
+};
+#endif
 
-    [0] = {"NOP",       1,      &nop},
+#if !defined(DISPATCH_INLINE) || defined(JIT)
+static const opcode_method opcode_methods[256] = {
+    #define OPCODE(code, name, cyc, method) [code] = &method,
+    #include "opcode_table.h"
+};
 
-    [0xc3] = {"JP a16", 4,      &jp_a16},
-    [0xe9] = {"JP HL", 1,   &jp_hl},
-    [0xc2] = {"JP NZ, a16", 0, &jp_nz_a16},
-    [0xd2] = {"JP NC, a16", 0, &jp_nc_a16},
-    [0xca] = {"JP Z, a16", 0, &jp_z_a16},
-    [0xda] = {"JP C, a16", 0, &jp_c_a16},
-    
-    [0x20] = {"JR NZ, s8", 0, &jr_nz},
-    [0x30] = {"JR NC, s8", 0, &jr_nc},
-    [0x18] = {"JR, s8", 0, &jr_s8},
-    [0x28] = {"JR Z, s8", 0, &jr_z},
-    [0x38] = {"JR C, s8", 0, &jr_c},
-
-    [0xf3] = {"DI",     1,   &di},
-
-    [0x31] = {"LD SP, d16", 3,  &ld_sp_16},
-    [0x21] = {"LD HL, d16", 3,  &ld_hl_16},
-    [0x11] = {"LD DE, d16", 3,  &ld_de_16},
-    [0x01] = {"LD BC, d16", 3,  &ld_bc_16},
-    
-    [0xc7] = {"RST 0", 4, &rst_0},
-    [0xcf] = {"RST 1", 4, &rst_1},
-    [0xd7] = {"RST 2", 4, &rst_2},
-    [0xdf] = {"RST 3", 4, &rst_3},
-    [0xe7] = {"RST 4", 4, &rst_4},
-    [0xef] = {"RST 5", 4, &rst_5},
-    [0xf7] = {"RST 6", 4, &rst_6},
-    [0xff] = {"RST 7", 4, &rst_7},
-
-    [0x3c] = {"INC A", 1, &inc_a},
-    [0x2c] = {"INC L", 1, &inc_l},
-    [0x1c] = {"INC E", 1, &inc_e},
-    [0x0c] = {"INC C", 1, &inc_c},
-    [0x04] = {"INC B", 1, &inc_b},
-    [0x14] = {"INC D", 1, &inc_d},
-    [0x24] = {"INC H", 1, &inc_h},
-    [0x34] = {"INC (HL)", 3, &inc_m},
-
-    [0x03] = {"INC BC", 2, &inc_bc},
-    [0x13] = {"INC DE", 2, &inc_de},
-    [0x23] = {"INC HL", 2, &inc_hl},
-    [0x33] = {"INC SP", 2, &inc_sp},
-
-    [0x0B] = {"DEC BC", 2, &dec_bc},
-    [0x1B] = {"DEC DE", 2, &dec_de},
-    [0x2B] = {"DEC HL", 2, &dec_hl},
-    [0x3B] = {"DEC SP", 2, &dec_sp},
-
-
-    [0xc9] = {"RET", 4, &ret},
-    [0xc0] = {"RET NZ", 0, &ret_nz},
-    [0xd0] = {"RET NC", 0, &ret_nc},
-    [0xc8] = {"RET Z", 0, &ret_z},
-    [0xd8] = {"RET C", 0, &ret_c},
-    [0xd9] = {"RETI", 4, &reti},
-
-    [0x40] = {"LD B, B", 1, &ld_b_b},
-    [0x41] = {"LD B, C", 1, &ld_b_c},
-    [0x42] = {"LD B, D", 1, &ld_b_d},
-    [0x43] = {"LD B, E", 1, &ld_b_e},
-    [0x44] = {"LD B, H", 1, &ld_b_h},
-    [0x45] = {"LD B, L", 1, &ld_b_l},
-    [0x47] = {"LD B, A", 1, &ld_b_a},
-    [0x48] = {"LD C, B", 1, &ld_c_b},
-    [0x49] = {"LD C, C", 1, &ld_c_c},
-    [0x4A] = {"LD C, D", 1, &ld_c_d},
-    [0x4B] = {"LD C, E", 1, &ld_c_e},
-    [0x4C] = {"LD C, H", 1, &ld_c_h},
-    [0x4D] = {"LD C, L", 1, &ld_c_l},
-    [0x4F] = {"LD C, A", 1, &ld_c_a},
-    [0x46] = {"LD B, (HL)", 2, &ld_b_m},
-    [0x4E] = {"LD C, (HL)", 2, &ld_c_m},
-
-    [0x50] = {"LD D, B", 1, &ld_d_b},
-    [0x51] = {"LD D, C", 1, &ld_d_c},
-    [0x52] = {"LD D, D", 1, &ld_d_d},
-    [0x53] = {"LD D, E", 1, &ld_d_e},
-    [0x54] = {"LD D, H", 1, &ld_d_h},
-    [0x55] = {"LD D, L", 1, &ld_d_l},
-    [0x57] = {"LD D, A", 1, &ld_d_a},
-    [0x58] = {"LD E, B", 1, &ld_e_b},
-    [0x59] = {"LD E, C", 1, &ld_e_c},
-    [0x5A] = {"LD E, D", 1, &ld_e_d},
-    [0x5B] = {"LD E, E", 1, &ld_e_e},
-    [0x5C] = {"LD E, H", 1, &ld_e_h},
-    [0x5D] = {"LD E, L", 1, &ld_e_l},
-    [0x5F] = {"LD E, A", 1, &ld_e_a},
-    [0x56] = {"LD D, (HL)", 2, &ld_d_m},
-    [0x5E] = {"LD E, (HL)", 2, &ld_e_m},
-    
+static const u8 opcode_cycles[256] = {
+    #define OPCODE(code, name, cyc, method) [code] = cyc,
+    #include "opcode_table.h"
+};
+#endif
 
-    [0x61] = {"LD H, C", 1, &ld_h_c},
-    [0x60] = {"LD H, B", 1, &ld_h_b},
-    [0x62] = {"LD H, D", 1, &ld_h_d},
-    [0x63] = {"LD H, E", 1, &ld_h_e},
-    [0x64] = {"LD H, H", 1, &ld_h_h},
-    [0x65] = {"LD H, L", 1, &ld_h_l},
-    [0x67] = {"LD H, A", 1, &ld_h_a},
-    [0x68] = {"LD L, B", 1, &ld_l_b},
-    [0x69] = {"LD L, C", 1, &ld_l_c},
-    [0x6A] = {"LD L, D", 1, &ld_l_d},
-    [0x6B] = {"LD L, E", 1, &ld_l_e},
-    [0x6C] = {"LD L, H", 1, &ld_l_h},
-    [0x6D] = {"LD L, L", 1, &ld_l_l},
-    [0x6F] = {"LD L, A", 1, &ld_l_a},
-    [0x66] = {"LD H, (HL)", 2, &ld_h_m},
-    [0x6E] = {"LD L, (HL)", 2, &ld_l_m},
-
-    [0x70] = {"LD (HL), B", 2, &ld_m_b},
-    [0x71] = {"LD (HL), C", 2, &ld_m_c},
-    [0x72] = {"LD (HL), D", 2, &ld_m_d},
-    [0x73] = {"LD (HL), E", 2, &ld_m_e},
-    [0x74] = {"LD (HL), H", 2, &ld_m_h},
-    [0x75] = {"LD (HL), L", 2, &ld_m_l},
-    [0x77] = {"LD (HL), A", 2, &ld_m_a},
-    [0x78] = {"LD A, B", 1, &ld_a_b},
-    [0x79] = {"LD A, C", 1, &ld_a_c},
-    [0x7A] = {"LD A, D", 1, &ld_a_d},
-    [0x7B] = {"LD A, E", 1, &ld_a_e},
-    [0x7C] = {"LD A, H", 1, &ld_a_h},
-    [0x7D] = {"LD A, L", 1, &ld_a_l},
-    [0x7F] = {"LD A, A", 1, &ld_a_a},
-    [0x7E] = {"LD A, (HL)", 2, &ld_a_m},
-
-    [0x02] = {"LD (BC), A", 2, &ld_bc_a},
-    [0x12] = {"LD (DE), A", 2, &ld_de_a},
-    [0x22] = {"LD (HL+), A", 2, &ld_hlp_a},
-    [0x32] = {"LD (HL-), A", 2, &ld_hlm_a},
-    [0x08] = {"LD (a16), SP", 5, &ld_a16_sp},
-
-
-    [0x06] = {"LD B, d8", 2, &ld_b_d8},
-    [0x16] = {"LD D, d8", 2, &ld_d_d8},
-    [0x26] = {"LD H, d8", 2, &ld_h_d8},
-    [0x36] = {"LD (HL), d8", 3, &ld_m_d8},
-
-    [0x0A] = {"LD A, (BC)", 2, &ld_a_bc},
-    [0x1A] = {"LD A, (DE)", 2, &ld_a_de},
-    [0x2A] = {"LD A, (HL+)", 2, &ld_a_hlp},
-    [0x3A] = {"LD A, (HL-)", 2, &ld_a_hlm},
-
-    [0x0E] = {"LD C, d8", 2, &ld_c_d8},
-    [0x1E] = {"LD E, d8", 2, &ld_e_d8},
-    [0x2E] = {"LD L, d8", 2, &ld_l_d8},
-    [0x3E] = {"LD A, d8", 2, &ld_a_d8},
-
-    [0xE0] = {"LD (a8), A", 3, &ld_a8_a},
-    [0xF0] = {"LD A, (a8)", 3, &ld_a_a8},
-    [0xEA] = {"LD (a16), A", 4, &ld_a16_a},
-    [0xFA] = {"LD A, (a16)", 4, &ld_a_a16},
-    [0xE2] = {"LD (m), A", 2, &ld_mc_a},
-    [0xF2] = {"LD A, (m)", 2, &ld_a_mc},
-
-    [0xf9] = {"LD SP, HL",2, &ld_sp_hl},
-    [0xf8] = {"LD HL, SP + s8",3, &ld_hl_sp_s8},
-
-    [0x80] = {"ADD B", 1, &add_a_b},
-    [0x81] = {"ADD C", 1, &add_a_c},
-    [0x82] = {"ADD D", 1, &add_a_d},
-    [0x83] = {"ADD E", 1, &add_a_e},
-    [0x84] = {"ADD H", 1, &add_a_h},
-    [0x85] = {"ADD L", 1, &add_a_l},
-    [0x86] = {"ADD M", 2, &add_a_m},
-    [0x87] = {"ADD A", 1, &add_a_a},
-
-    [0xE8] = {"ADD SP, s8", 4, &add_sp_s8},
-
-    [0x88] = {"ADc B", 1, &adc_b},
-    [0x89] = {"ADc C", 1, &adc_c},
-    [0x8A] = {"ADc D", 1, &adc_d},
-    [0x8B] = {"ADc E", 1, &adc_e},
-    [0x8C] = {"ADc H", 1, &adc_h},
-    [0x8D] = {"ADc L", 1, &adc_l},
-    [0x8E] = {"ADc M", 2, &adc_m},
-    [0x8F] = {"ADc A", 1, &adc_a},
-    [0x27] = {"DAA", 1, &daa},
-    [0x37] = {"SCF", 1, &scf},
-
-    [0x09] = {"ADD HL, BC", 2, &add_hl_bc},
-    [0x19] = {"ADD HL, DE", 2, &add_hl_de},
-    [0x29] = {"ADD HL, HL", 2, &add_hl_hl},
-    [0x39] = {"ADD HL, SP", 2, &add_hl_sp},
-
-    [0x90] = {"SUB B", 1, &sub_b},
-    [0x91] = {"SUB C", 1, &sub_c},
-    [0x92] = {"SUB D", 1, &sub_d},
-    [0x93] = {"SUB E", 1, &sub_e},
-    [0x94] = {"SUB H", 1, &sub_h},
-    [0x95] = {"SUB L", 1, &sub_l},
-    [0x96] = {"SUB M", 2, &sub_m},
-    [0x97] = {"SUB A", 1, &sub_a},
-    [0x98] = {"Sbc B", 1, &sbc_b},
-    [0x99] = {"Sbc C", 1, &sbc_c},
-    [0x9A] = {"Sbc D", 1, &sbc_d},
-    [0x9B] = {"Sbc E", 1, &sbc_e},
-    [0x9C] = {"Sbc H", 1, &sbc_h},
-    [0x9D] = {"Sbc L", 1, &sbc_l},
-    [0x9E] = {"Sbc M", 2, &sbc_m},
-    [0x9F] = {"Sbc A", 1, &sbc_a},
-
-    [0xA0] = {"and B", 1, &and_b},
-    [0xA1] = {"and C", 1, &and_c},
-    [0xA2] = {"and D", 1, &and_d},
-    [0xA3] = {"and E", 1, &and_e},
-    [0xA4] = {"and H", 1, &and_h},
-    [0xA5] = {"and L", 1, &and_l},
-    [0xA6] = {"and M", 2, &and_m},
-    [0xA7] = {"and A", 1, &and_a},
-    [0xA8] = {"XOR B", 1, &xor_b},
-    [0xA9] = {"XOR C", 1, &xor_c},
-    [0xAA] = {"XOR D", 1, &xor_d},
-    [0xAB] = {"XOR E", 1, &xor_e},
-    [0xAC] = {"XOR H", 1, &xor_h},
-    [0xAD] = {"XOR L", 1, &xor_l},
-    [0xAE] = {"XOR M", 2, &xor_m},
-    [0xAF] = {"XOR A", 1, &xor_a},
-
-    [0xB0] = {"or B", 1, &or_b},
-    [0xB1] = {"or C", 1, &or_c},
-    [0xB2] = {"or D", 1, &or_d},
-    [0xB3] = {"or E", 1, &or_e},
-    [0xB4] = {"or H", 1, &or_h},
-    [0xB5] = {"or L", 1, &or_l},
-    [0xB6] = {"or M", 2, &or_m},
-    [0xB7] = {"or A", 1, &or_a},
-    [0xB8] = {"CP B", 1, &cp_b},
-    [0xB9] = {"CP C", 1, &cp_c},
-    [0xBA] = {"CP D", 1, &cp_d},
-    [0xBB] = {"CP E", 1, &cp_e},
-    [0xBC] = {"CP H", 1, &cp_h},
-    [0xBD] = {"CP L", 1, &cp_l},
-    [0xBE] = {"CP M", 2, &cp_m},
-    [0xBF] = {"CP A", 1, &cp_a},
-
-    [0xC6] = {"ADD A, d8", 2, &add_a_d8},
-    [0xD6] = {"SUB A, d8", 2, &sub_d8},
-    [0xE6] = {"AND A, d8", 2, &and_d8},
-    [0xF6] = {"OR A, d8", 2, &or_d8},
-    [0x07] = {"RLCA", 1, &rlca},
-    [0x17] = {"RLA", 1, &rla},
-
-
-    [0xCE] = {"ADC A, d8", 2, &adc_a_d8},
-    [0xDE] = {"SBC A, d8", 2, &sbc_d8},
-    [0xEE] = {"XOR A, d8", 2, &xor_d8},
-    [0xFE] = {"CP A, d8", 2, &cp_d8},
-
-    [0x05] = {"DEC B", 1, &dec_b},
-    [0x15] = {"DEC D", 1, &dec_d},
-    [0x25] = {"DEC H", 1, &dec_h},
-    [0x35] = {"DEC (HL)", 3, &dec_m},
-
-    [0x0D] = {"DEC C", 1, &dec_c},
-    [0x1D] = {"DEC E", 1, &dec_e},
-    [0x2D] = {"DEC L", 1, &dec_l},
-    [0x3D] = {"DEC A", 1, &dec_a},
-
-    [0xCD] = {"CALL a16",0, &call_a16},
-    [0xC4] = {"CALL NZ, a16",0, &call_nz_a16},
-    [0xD4] = {"CALL NC, a16",0, &call_nc_a16},
-    [0xCC] = {"CALL Z, a16",0, &call_z_a16},
-    [0xDC] = {"CALL C, a16",0, &call_c_a16},
-    
-    [0xc1] = {"POP BC",3, &pop_bc},
-    [0xd1] = {"POP DE",3, &pop_de},
-    [0xe1] = {"POP HL",3, &pop_hl},
-    [0xf1] = {"POP AF",3, &pop_af},
-
-    [0xc5] = {"PUSH BC",4, &push_bc},
-    [0xd5] = {"PUSH DE",4, &push_de},
-    [0xe5] = {"PUSH HL",4, &push_hl},
-    [0xf5] = {"PUSH AF",4, &push_af},
-
-    [0x0f] = {"RRCA", 1, &rrca},
-    [0x1f] = {"RRA", 1 , &rra}, 
-    
-    [0xfb] = {"EI", 1, &ei},
 
-    [0x2f] = {"CPL", 1, &cpl},
-    [0x3f] = {"CCF", 1, &ccf},
+#ifdef BLOCK_CACHE
+/* Instruction sizes in bytes, CB prefixed ones are all 2 */
+static const u8 opcode_lengths[256] = {
+    [0x01] = 3, [0x11] = 3, [0x21] = 3, [0x31] = 3, [0x08] = 3,
+    [0xC2] = 3, [0xC3] = 3, [0xC4] = 3, [0xCA] = 3, [0xCC] = 3, [0xCD] = 3,
+    [0xD2] = 3, [0xD4] = 3, [0xDA] = 3, [0xDC] = 3, [0xEA] = 3, [0xFA] = 3,
 
-    [0x76] = {"HALT", 1, &halt},
+    [0x06] = 2, [0x0E] = 2, [0x16] = 2, [0x1E] = 2, [0x26] = 2, [0x2E] = 2, [0x36] = 2, [0x3E] = 2,
+    [0x10] = 2, [0x18] = 2, [0x20] = 2, [0x28] = 2, [0x30] = 2, [0x38] = 2,
+    [0xC6] = 2, [0xCE] = 2, [0xD6] = 2, [0xDE] = 2, [0xE6] = 2, [0xEE] = 2, [0xF6] = 2, [0xFE] = 2,
+    [0xE0] = 2, [0xF0] = 2, [0xE8] = 2, [0xF8] = 2, [0xCB] = 2,
 };
 
+/* Jumps, calls, returns, rst, halt and stop end a block */
+static inline bool ends_block(u8 opcode){
+    switch (opcode){
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9:
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC:
+        case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9:
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+        case 0x76: case 0x10:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* ROM, WRAM and HRAM, everything else is decoded every time it runs */
+static inline bool is_cacheable(u16 pc){
+    return pc < 0x8000 || (pc >= 0xC000 && pc <= 0xDFFF) || (pc >= 0xFF80 && pc <= 0xFFFE);
+}
+
+static inline u8 op_length(u8 opcode){
+    return opcode_lengths[opcode] ? opcode_lengths[opcode] : 1;
+}
+
+static void block_decode(CPU *cpu, Block *block, u16 start){
+    Memory *mem = cpu->p_memory;
+    int last = (start >= 0xFF80) ? 0xFFFE : (start | 0xFF);
+    int pc = start;
+
+    block->start = start;
+    block->count = 0;
+    #ifdef JIT
+    block->hits = 0;
+    block->native = NULL;
+    #endif
+
+    while (block->count < BLOCK_MAX_OPS){
+        u8 opcode = memory_read_8(mem, pc);
+        u8 len = op_length(opcode);
+        if (pc + len - 1 > last) break;
+
+        DecodedOp *op = &block->ops[block->count++];
+        op->pc = pc;
+        op->opcode = opcode;
+        for (int i = 0; i < len; i++){
+            if (i > 0) op->imm[i - 1] = memory_read_8(mem, pc + i);
+            memory_mark_code(mem, pc + i);
+        }
+
+        pc += len;
+        if (ends_block(opcode) || pc > last) break;
+    }
+}
+
+static void block_enter(CPU *cpu, const Block *block){
+    cpu->next_op = block->ops + 1;
+    cpu->block_end = block->ops + block->count;
+}
+
+static const DecodedOp *block_miss(CPU *cpu, u16 pc){
+    if (is_cacheable(pc)){
+        Block *block = &cpu->blocks[pc & (BLOCK_CACHE_SIZE - 1)];
+        block_decode(cpu, block, pc);
+
+        if (block->count != 0){
+            block_enter(cpu, block);
+            return block->ops;
+        }
+    }
+
+    // operands are read in order, same as the plain fetch would
+    DecodedOp *op = &cpu->uncached;
+    op->pc = pc;
+    op->opcode = memory_read_8(cpu->p_memory, pc);
+    for (int i = 1; i < op_length(op->opcode); i++)
+        op->imm[i - 1] = memory_read_8(cpu->p_memory, pc + i);
+
+    cpu->next_op = cpu->block_end = NULL;
+    return op;
+}
+
+/* Decoded code in the page was overwritten, drop its blocks and the one being walked */
+static void block_invalidate(void *ctx, u8 page){
+    CPU *cpu = ctx;
+
+    for (int i = 0; i < 0x100; i++){
+        Block *block = &cpu->blocks[((page << 8) | i) & (BLOCK_CACHE_SIZE - 1)];
+        if ((block->start >> 8) == page) block->count = 0;
+    }
+    cpu->next_op = cpu->block_end = NULL;
+}
+
+/* Next decoded instruction, walks the current block while PC follows it */
+static inline const DecodedOp *block_fetch(CPU *cpu){
+    u16 pc = cpu->PC.val;
+    const DecodedOp *op = cpu->next_op;
+
+    if (op < cpu->block_end && op->pc == pc){
+        cpu->next_op = op + 1;
+        return op;
+    }
+
+    const Block *block = &cpu->blocks[pc & (BLOCK_CACHE_SIZE - 1)];
+    if (block->start == pc && block->count != 0){
+        block_enter(cpu, block);
+        return block->ops;
+    }
+    return block_miss(cpu, pc);
+}
+#endif
+
+#ifdef JIT
+#ifndef JIT_HOT
+#define JIT_HOT 16 // entries before a block is translated
+#endif
+#ifndef JIT_BUFFER_SIZE
+#define JIT_BUFFER_SIZE (1 << 20)
+#endif
+#define JIT_NEVER 0xFF
+#define JIT_MAX_CODE 1024 // worst case size of one translated block
+
+typedef void (*native_block)(CPU *);
+
+/* EI, HALT, STOP and anything unimplemented always go through step_cpu */
+static inline bool jit_excluded(const DecodedOp *op){
+    switch (op->opcode){
+        case 0xFB: case 0x76: case 0x10:
+            return true;
+        case 0xCB:
+            return prefixed_opcode_methods[op->imm[0]] == NULL;
+        default:
+            return opcode_methods[op->opcode] == NULL;
+    }
+}
+
+/* Reads or writes memory other than its own immediates, translation stops after it */
+static inline bool jit_touches_memory(const DecodedOp *op){
+    u8 opcode = op->opcode;
+
+    if (opcode == 0xCB) return (op->imm[0] & 7) == 6;
+    if (opcode >= 0x70 && opcode <= 0x77) return true;
+    if (opcode >= 0x40 && opcode <= 0xBF) return (opcode & 7) == 6;
+
+    switch (opcode){
+        case 0x02: case 0x0A: case 0x12: case 0x1A: case 0x08:
+        case 0x22: case 0x2A: case 0x32: case 0x3A: case 0x34: case 0x35: case 0x36:
+        case 0xE0: case 0xF0: case 0xE2: case 0xF2: case 0xEA: case 0xFA:
+        case 0xC1: case 0xD1: case 0xE1: case 0xF1: case 0xC5: case 0xD5: case 0xE5: case 0xF5:
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC:
+        case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9:
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Offsets into CPU of the B C D E H L - A operand encoding */
+static size_t jit_reg8(u8 r){
+    switch (r){
+        case 0: return offsetof(CPU, BC.hi);
+        case 1: return offsetof(CPU, BC.lo);
+        case 2: return offsetof(CPU, DE.hi);
+        case 3: return offsetof(CPU, DE.lo);
+        case 4: return offsetof(CPU, HL.hi);
+        case 5: return offsetof(CPU, HL.lo);
+        default: return offsetof(CPU, AF.hi);
+    }
+}
+
+/* BC DE HL SP, from bits 4-5 of the opcode */
+static size_t jit_reg16(u8 opcode){
+    static const size_t regs[4] = {offsetof(CPU, BC), offsetof(CPU, DE), offsetof(CPU, HL), offsetof(CPU, SP)};
+    return regs[(opcode >> 4) & 3];
+}
+
+static u8 *emit_32(u8 *p, u32 val){ memcpy(p, &val, 4); return p + 4; }
+static u8 *emit_64(u8 *p, uint64_t val){ memcpy(p, &val, 8); return p + 8; }
+
+/* ModRM for [rbx + disp32], reg is the register or the opcode extension */
+static u8 *emit_rbx(u8 *p, u8 reg, size_t disp){
+    *p++ = 0x83 | reg << 3;
+    return emit_32(p, (u32)disp);
+}
+
+/* mov word [rbx + disp], imm16 */
+static u8 *emit_store_16(u8 *p, size_t disp, u16 val){
+    *p++ = 0x66; *p++ = 0xC7;
+    p = emit_rbx(p, 0, disp);
+    *p++ = val & 0xFF; *p++ = val >> 8;
+    return p;
+}
+
+/* handler(cpu) through rax, rbx holds the CPU pointer */
+static u8 *emit_call(u8 *p, const void *fn){
+    *p++ = 0x48; *p++ = 0x89; *p++ = 0xDF;  // mov rdi, rbx
+    *p++ = 0x48; *p++ = 0xB8;
+    p = emit_64(p, (uint64_t)(uintptr_t)fn);
+    *p++ = 0xFF; *p++ = 0xD0;
+    return p;
+}
+
+/* mov qword [rbx + disp], imm64 through rax */
+static u8 *emit_store_ptr(u8 *p, size_t disp, const void *ptr){
+    *p++ = 0x48; *p++ = 0xB8;
+    p = emit_64(p, (uint64_t)(uintptr_t)ptr);
+    *p++ = 0x48; *p++ = 0x89;
+    return emit_rbx(p, 0, disp);
+}
+
+/* Register loads and 16 bit INC/DEC become plain moves, NULL when the op needs its handler */
+static u8 *emit_inline(u8 *p, const DecodedOp *op){
+    u8 opcode = op->opcode;
+
+    if (opcode == 0x00){
+        // nop
+    }
+    else if (opcode >= 0x40 && opcode <= 0x7F && (opcode & 7) != 6 && (opcode & 0x38) != 0x30){
+        // ld r, r'
+        *p++ = 0x0F; *p++ = 0xB6;
+        p = emit_rbx(p, 0, jit_reg8(opcode & 7));
+        *p++ = 0x88;
+        p = emit_rbx(p, 0, jit_reg8((opcode >> 3) & 7));
+    }
+    else if ((opcode & 0xC7) == 0x06 && opcode != 0x36){
+        // ld r, d8
+        *p++ = 0xC6;
+        p = emit_rbx(p, 0, jit_reg8((opcode >> 3) & 7));
+        *p++ = op->imm[0];
+    }
+    else if ((opcode & 0xCF) == 0x01){
+        // ld rr, d16
+        p = emit_store_16(p, jit_reg16(opcode), combine_bytes(op->imm[1], op->imm[0]));
+    }
+    else if ((opcode & 0xC7) == 0x03){
+        // inc rr / dec rr
+        *p++ = 0x66; *p++ = 0xFF;
+        p = emit_rbx(p, (opcode & 0x08) ? 1 : 0, jit_reg16(opcode));
+    }
+    else return NULL;
+
+    return p;
+}
+
+/* Drops every translation, the buffer is reused from the start */
+static void jit_flush(CPU *cpu){
+    for (int i = 0; i < BLOCK_CACHE_SIZE; i++){
+        cpu->blocks[i].native = NULL;
+        cpu->blocks[i].hits = 0;
+    }
+    cpu->jit_used = 0;
+}
+
+/* add qword [rbx + cycles], imm32 */
+static u8 *emit_add_cycles(u8 *p, int cycles){
+    *p++ = 0x48; *p++ = 0x81;
+    p = emit_rbx(p, 0, offsetof(CPU, cycles));
+    return emit_32(p, cycles);
+}
+
+/*  Translates the block up to and including its first memory access or branch.
+ *  Handlers are called with PC, the operand pointer and the master clock set as step_cpu
+ *  would, so the one access sees peripherals exactly where the interpreter has them.
+ *  The cycles of inlined ops are summed and only added before the next handler call or
+ *  at the exit. block->span gets the cycles of every op but the last, see jit_run.
+ */
+static void *jit_translate(CPU *cpu, Block *block){
+    if (cpu->jit_code == NULL){
+        void *code = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED){
+            printf("[JIT] could not map code buffer, using the interpreter\n");
+            cpu->jit_enabled = false;
+            return NULL;
+        }
+        cpu->jit_code = code;
+    }
+    if (cpu->jit_used + JIT_MAX_CODE > JIT_BUFFER_SIZE) jit_flush(cpu);
+
+    u8 *start = cpu->jit_code + cpu->jit_used;
+    u8 *p = start;
+    int cycles = 0, span = 0, last = 0, count = 0;
+    u16 end_pc = 0;
+    bool pc_written = false;
+
+    *p++ = 0x53;                            // push rbx
+    *p++ = 0x48; *p++ = 0x89; *p++ = 0xFB;  // mov rbx, rdi
+
+    for (int i = 0; i < block->count; i++){
+        const DecodedOp *op = &block->ops[i];
+        if (jit_excluded(op)) break;
+
+        span += last;
+
+        u8 *next = emit_inline(p, op);
+        if (next != NULL){
+            p = next;
+            last = opcode_cycles[op->opcode];
+            pc_written = false;
+        }
+        else{
+            // the handler runs at the master clock the interpreter would run it at
+            if (cycles != 0) p = emit_add_cycles(p, cycles);
+            cycles = 0;
+
+            if (op->opcode == 0xCB){
+                p = emit_store_16(p, offsetof(CPU, PC), op->pc + 2);
+                p = emit_call(p, prefixed_opcode_methods[op->imm[0]]);
+                last = prefixed_opcode_cycles[op->imm[0]];
+                pc_written = false;
+            }
+            else{
+                // the handler reads its immediates and leaves PC where the op ends or jumps
+                p = emit_store_16(p, offsetof(CPU, PC), op->pc + 1);
+                if (op_length(op->opcode) > 1) p = emit_store_ptr(p, offsetof(CPU, operand), op->imm);
+                p = emit_call(p, opcode_methods[op->opcode]);
+                last = opcode_cycles[op->opcode];
+                pc_written = true;
+            }
+        }
+        cycles += last;
+
+        count++;
+        end_pc = op->pc + op_length(op->opcode);
+        if (jit_touches_memory(op) || ends_block(op->opcode)) break;
+    }
+
+    if (count == 0) return NULL;
+
+    if (!pc_written) p = emit_store_16(p, offsetof(CPU, PC), end_pc);
+    if (cycles != 0) p = emit_add_cycles(p, cycles);
+    *p++ = 0x5B;  // pop rbx
+    *p++ = 0xC3;  // ret
+
+    cpu->jit_used += p - start;
+    block->span = span;
+    return start;
+}
+
+/*  Runs the translation of the block at PC, 0 leaves the step to the interpreter.
+ *  The main loop syncs peripherals and takes interrupts between instructions once the master
+ *  clock reaches the scheduler's deadline. A block whose inner instruction boundaries would
+ *  reach it is interpreted, so timer and PPU interrupts are taken after the same instruction.
+ *  Nothing else can raise IF & IE mid block, only its last op touches memory.
+ */
+static int jit_run(CPU *cpu){
+    u16 pc = cpu->PC.val;
+    Block *block = &cpu->blocks[pc & (BLOCK_CACHE_SIZE - 1)];
+    if (block->start != pc || block->count == 0) return 0;
+
+    if (block->native == NULL){
+        if (block->hits == JIT_NEVER || ++block->hits < JIT_HOT) return 0;
+
+        block->native = jit_translate(cpu, block);
+        if (block->native == NULL){
+            block->hits = JIT_NEVER;
+            return 0;
+        }
+    }
+
+    u64 prev_cycles = cpu->cycles;
+    if (cpu->deadline != NULL && prev_cycles + block->span >= *cpu->deadline) return 0;
+
+    ((native_block)block->native)(cpu);
+    return cpu->cycles - prev_cycles;
+}
+#endif
+
+/* Hooks the block cache into memory writes, call once the CPU has its final address */
+void cpu_register_block_cache(CPU *cpu){
+    #ifdef BLOCK_CACHE
+    cpu->p_memory->code_written = block_invalidate;
+    cpu->p_memory->code_ctx = cpu;
+    #else
+    (void)cpu;
+    #endif
+}
+
+/*  Recognises a polling loop at PC that only reads one PPU, timer or IF register:
+ *      LD A, (a8) / LD A, (a16)
+ *      CP A, d8   / AND A, d8
+ *      JR NZ / JR Z back to the load
+ *  Returns the M-cycles of one iteration when the loop would go round again with the
+ *  register's current value, 0 otherwise. The polled address is stored in *polled.
+ */
+int cpu_idle_loop(CPU *cpu, u16 *polled){
+    Memory *mem = cpu->p_memory;
+    u16 pc = cpu->PC.val;
+    u16 addr;
+    int len, cycles;
+
+    if (cpu->is_halted || cpu->schedule_ei != 0) return 0;
+
+    switch (memory_read_8(mem, pc)){
+        case 0xF0: addr = 0xFF00 | memory_read_8(mem, pc + 1); len = 2; cycles = 3; break;
+        case 0xFA: addr = combine_bytes(memory_read_8(mem, pc + 2), memory_read_8(mem, pc + 1)); len = 3; cycles = 4; break;
+        default: return 0;
+    }
+
+    // LY, STAT, IF, DIV and TIMA only change on timer or PPU events
+    if (addr != 0xFF44 && addr != 0xFF41 && addr != 0xFF0F && addr != 0xFF04 && addr != 0xFF05) return 0;
+
+    u8 test = memory_read_8(mem, pc + len);
+    u8 operand = memory_read_8(mem, pc + len + 1);
+    u8 jump = memory_read_8(mem, pc + len + 2);
+    s8 offset = (s8)memory_read_8(mem, pc + len + 3);
+
+    if ((test != 0xFE && test != 0xE6) || (jump != 0x20 && jump != 0x28)) return 0;
+    if (offset != -(len + 4)) return 0;
+
+    u8 val = memory_read_8(mem, addr);
+    bool zero = (test == 0xFE) ? (val == operand) : ((val & operand) == 0);
+    if (zero != (jump == 0x28)) return 0;
+
+    // CP / AND d8 is 2 cycles, the taken JR 3
+    *polled = addr;
+    return cycles + 2 + 3;
+}
 
 // steps the CPU
 int step_cpu(CPU *cpu){
     if(cpu->is_halted){
         return 1;
     }
+
+    // translated blocks run whole, a pending EI needs the per instruction countdown
+    #ifdef JIT
+    if (cpu->jit_enabled && cpu->schedule_ei == 0){
+        int cycles = jit_run(cpu);
+        if (cycles != 0) return cycles;
+    }
+    #endif
     // logging
     #ifdef LOG
+    flags_flush(cpu);
     char temp[128];
 
     int len = snprintf(
@@ -2439,8 +2455,14 @@ int step_cpu(CPU *cpu){
 
     #endif
 
-    size_t prev_cycles = cpu->cycles;
+    u64 prev_cycles = cpu->cycles;
+    #ifdef BLOCK_CACHE
+    const DecodedOp *op = block_fetch(cpu);
+    u8 opcode = op->opcode;
+    cpu->operand = op->imm;
+    #else
     u8 opcode = memory_read_8(cpu->p_memory, cpu->PC.val);
+    #endif
     
 
     // next instructions
@@ -2449,15 +2471,44 @@ int step_cpu(CPU *cpu){
     // interrupt
 
     // execute the instruction
-    Opcode to_exec = opcodes[opcode];
-    if (to_exec.opcode_method == NULL){printf("NOT IMPLEMENTED OPCODE: %x\n",opcode); exit(1);}
+    #ifdef DISPATCH_THREADED
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Woverride-init"
+    static const void *dispatch[256] = {
+        [0 ... 255] = &&unimplemented,
+        #define OPCODE(code, name, cyc, method) [code] = &&op_##code,
+        #include "opcode_table.h"
+    };
+    #pragma GCC diagnostic pop
 
-    #ifdef DEBUG
-        printf("[EXECUTING THE INSTRUCTION: %s]\n",to_exec.name);
-    #endif
+    goto *dispatch[opcode];
+
+    #define OPCODE(code, name, cyc, method) \
+        op_##code: TRACE_OPCODE("[EXECUTING THE INSTRUCTION: %s]\n", opcode_names, code); method(cpu); cpu->cycles += cyc; goto executed;
+    #include "opcode_table.h"
+
+unimplemented:
+    printf("NOT IMPLEMENTED OPCODE: %x\n",opcode); exit(1);
+executed:
 
-    to_exec.opcode_method(cpu);
-    cpu->cycles += to_exec.cycles;
+    #elif defined(DISPATCH_SWITCH)
+    switch (opcode){
+        #define OPCODE(code, name, cyc, method) \
+            case code: TRACE_OPCODE("[EXECUTING THE INSTRUCTION: %s]\n", opcode_names, code); method(cpu); cpu->cycles += cyc; break;
+        #include "opcode_table.h"
+
+        default: printf("NOT IMPLEMENTED OPCODE: %x\n",opcode); exit(1);
+    }
+
+    #else
+    opcode_method method = opcode_methods[opcode];
+    if (method == NULL){printf("NOT IMPLEMENTED OPCODE: %x\n",opcode); exit(1);}
+
+    TRACE_OPCODE("[EXECUTING THE INSTRUCTION: %s]\n", opcode_names, opcode);
+
+    method(cpu);
+    cpu->cycles += opcode_cycles[opcode];
+    #endif
 
     // scheduled interrupt
     if (cpu->schedule_ei != 0){
@@ -2466,7 +2517,7 @@ int step_cpu(CPU *cpu){
     }
 
     #ifdef DEBUG
-    printf("INSTRUCTION TOOK %d\n",cpu->cycles - prev_cycles);
+    printf("INSTRUCTION TOOK %d\n",(int)(cpu->cycles - prev_cycles));
     #endif
         
     return (cpu->cycles - prev_cycles);
@@ -18,6 +18,48 @@ typedef union {
     u16 val;
 } reg16;
 
+/* Operands of the last ALU op, see LAZY_FLAGS in cpu.c */
+typedef struct {
+    u8 op;
+    u8 res;
+    u8 carry_in; // ADC / SBC carry
+    u8 keep;     // flag bits the op leaves untouched
+    u16 a;
+    u16 b;
+} LazyFlags;
+
+/* One pre-decoded instruction, get_next_8 serves the operands from imm */
+typedef struct {
+    u16 pc;
+    u8 opcode;
+    u8 imm[2];
+} DecodedOp;
+
+#ifndef BLOCK_MAX_OPS
+#define BLOCK_MAX_OPS 16
+#endif
+#ifndef BLOCK_CACHE_SIZE
+#define BLOCK_CACHE_SIZE 4096 // direct mapped on the start pc
+#endif
+
+/* The JIT translates decoded blocks into x86-64, it is dropped on any other setup */
+#if defined(JIT) && (!defined(BLOCK_CACHE) || !defined(__x86_64__) || defined(LOG))
+    #undef JIT
+#endif
+
+/* Straight line run of instructions, never crosses a 256 byte page */
+typedef struct {
+    u16 start;
+    u8 count; // 0 for an empty slot
+    DecodedOp ops[BLOCK_MAX_OPS];
+
+    #ifdef JIT
+    u8 hits;      // entries so far, JIT_NEVER once the block was found untranslatable
+    void *native; // translated code, NULL until the block is hot
+    u16 span;     // M-cycles of the translated ops before the last one
+    #endif
+} Block;
+
 typedef struct
 {
     
@@ -31,7 +73,7 @@ typedef struct
 
     // memory
     Memory *p_memory;
-    int cycles;
+    u64 cycles; // master clock in M-cycles since power on, every component reads it
 
     //interrupts
     u8 IME;
@@ -47,20 +89,39 @@ typedef struct
 
     bool is_halted;
 
+    // last ALU op whose flags are not folded into AF.lo yet
+    #ifdef LAZY_FLAGS
+    LazyFlags lazy;
+    #endif
 
-}CPU;
+    // decoded block cache, see BLOCK_CACHE in cpu.c
+    #ifdef BLOCK_CACHE
+    Block *blocks;
+    const DecodedOp *next_op;
+    const DecodedOp *block_end;
+    const u8 *operand;  // immediates of the executing instruction
+    DecodedOp uncached; // instruction outside the cacheable regions
+    #endif
 
+    // runtime switch for the x86-64 translation, see JIT in cpu.c
+    #ifdef JIT
+    bool jit_enabled;
+    u8 *jit_code;    // executable buffer, mapped on the first translation
+    size_t jit_used;
+    const u64 *deadline; // the scheduler's next deadline, NULL for none
+    #endif
 
- CPU init_cpu(Memory *p_mem);
 
-typedef struct {
-    char name[15];
+}CPU;
+
 
-    u8 cycles;
+ CPU init_cpu(Memory *p_mem);
 
-    void (*opcode_method)();
-}Opcode;
+/* Opcode handler, the cycles and mnemonics live in separate tables in cpu.c */
+typedef void (*opcode_method)(CPU *);
 
 int step_cpu(CPU *);
+void cpu_register_block_cache(CPU *);
+int cpu_idle_loop(CPU *cpu, u16 *polled);
 void push(CPU *, u8);
 void rst_helper(CPU *cpu, u16 addr);
\ No newline at end of file
@@ -0,0 +1,98 @@
+/*  gen_alu_tables.c
+ *
+ *  Build time generator for processor/alu_tables.h (see ALU_TABLES in platform.h).
+ *  Every entry holds the result in the low byte and the Z/N/H/C flags in the high
+ *  byte, so the ALU helpers get both with a single load.
+ */
+#include <stdio.h>
+#include <stdint.h>
+
+#define ZERO 0x80
+#define SUBTRACT 0x40
+#define HALF_CARRY 0x20
+#define CARRY 0x10
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+
+static u16 entry(u8 result, u8 flags){ return (u16)(flags << 8) | result; }
+
+static u16 add(u8 a, u8 b, u8 c){
+    u16 sum = a + b + c;
+    u8 f = 0;
+
+    if ((u8)sum == 0) f |= ZERO;
+    if (((a & 0x0F) + (b & 0x0F) + c) > 0x0F) f |= HALF_CARRY;
+    if (sum > 0xFF) f |= CARRY;
+    return entry((u8)sum, f);
+}
+
+static u16 sub(u8 a, u8 b, u8 c){
+    u8 diff = a - b - c;
+    u8 f = SUBTRACT;
+
+    if (diff == 0) f |= ZERO;
+    if ((a & 0x0F) < ((b & 0x0F) + c)) f |= HALF_CARRY;
+    if (a < (b + c)) f |= CARRY;
+    return entry(diff, f);
+}
+
+/* INC and DEC leave the carry alone, so it is not part of the entry */
+static u16 inc(u8 a){
+    u8 res = a + 1;
+    return entry(res, (res == 0 ? ZERO : 0) | ((a & 0x0F) == 0x0F ? HALF_CARRY : 0));
+}
+
+static u16 dec(u8 a){
+    u8 res = a - 1;
+    return entry(res, (res == 0 ? ZERO : 0) | SUBTRACT | ((a & 0x0F) == 0x00 ? HALF_CARRY : 0));
+}
+
+/* index is A | N << 8 | H << 9 | C << 10 */
+static u16 daa(u16 index){
+    u8 a = index & 0xFF;
+    u8 n = (index >> 8) & 1, h = (index >> 9) & 1, c = (index >> 10) & 1;
+    u8 adjust = 0;
+    u8 carry = c;
+
+    if (!n) {
+        if (h || (a & 0x0F) > 9)
+            adjust |= 0x06;
+        if (c || a > 0x99) {
+            adjust |= 0x60;
+            carry = 1;
+        }
+        a += adjust;
+    } else {
+        if (h) adjust |= 0x06;
+        if (c) adjust |= 0x60;
+        a -= adjust;
+    }
+
+    return entry(a, (a == 0 ? ZERO : 0) | (n ? SUBTRACT : 0) | (carry ? CARRY : 0));
+}
+
+static void emit(const char *decl, u16 (*gen)(unsigned), unsigned count){
+    printf("static const u16 %s = {", decl);
+    for (unsigned i = 0; i < count; i++)
+        printf("%s0x%04x,", (i % 16) ? "" : "\n    ", gen(i));
+    printf("\n};\n\n");
+}
+
+static u16 add_at(unsigned i){ return add(i & 0xFF, (i >> 8) & 0xFF, i >> 16); }
+static u16 sub_at(unsigned i){ return sub(i & 0xFF, (i >> 8) & 0xFF, i >> 16); }
+static u16 inc_at(unsigned i){ return inc(i); }
+static u16 dec_at(unsigned i){ return dec(i); }
+static u16 daa_at(unsigned i){ return daa(i); }
+
+int main(void){
+    printf("/* Generated by processor/gen_alu_tables.c, do not edit */\n\n");
+    printf("#pragma once\n\n");
+    // index is A | operand << 8 | carry << 16
+    emit("alu_add_table[2 * 256 * 256]", add_at, 2 * 256 * 256);
+    emit("alu_sub_table[2 * 256 * 256]", sub_at, 2 * 256 * 256);
+    emit("alu_inc_table[256]", inc_at, 256);
+    emit("alu_dec_table[256]", dec_at, 256);
+    emit("alu_daa_table[2048]", daa_at, 2048);
+    return 0;
+}
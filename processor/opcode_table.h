@@ -0,0 +1,615 @@
+/*  opcode_table.h
+ *
+ *  Every implemented opcode as an X-macro list, so the function pointer tables
+ *  and the switch / computed goto dispatch in cpu.c are built from one place.
+ *  Define OPCODE(code, name, cycles, method) and CB_OPCODE(...) before including.
+ *  Cycles of 0 means the method adds its own (branches and the CB prefix).
+ */
+
+#ifndef OPCODE
+#define OPCODE(code, name, cycles, method)
+#endif
+
+#ifndef CB_OPCODE
+#define CB_OPCODE(code, name, cycles, method)
+#endif
+
+/* Non prefixed */
+    OPCODE(0xCB, "CB Prefixed", 0, cb_helper)
+
+    OPCODE(0x00, "NOP", 1, nop)
+
+    OPCODE(0xc3, "JP a16", 4, jp_a16)
+    OPCODE(0xe9, "JP HL", 1, jp_hl)
+    OPCODE(0xc2, "JP NZ, a16", 0, jp_nz_a16)
+    OPCODE(0xd2, "JP NC, a16", 0, jp_nc_a16)
+    OPCODE(0xca, "JP Z, a16", 0, jp_z_a16)
+    OPCODE(0xda, "JP C, a16", 0, jp_c_a16)
+
+    OPCODE(0x20, "JR NZ, s8", 0, jr_nz)
+    OPCODE(0x30, "JR NC, s8", 0, jr_nc)
+    OPCODE(0x18, "JR, s8", 0, jr_s8)
+    OPCODE(0x28, "JR Z, s8", 0, jr_z)
+    OPCODE(0x38, "JR C, s8", 0, jr_c)
+
+    OPCODE(0xf3, "DI", 1, di)
+
+    OPCODE(0x31, "LD SP, d16", 3, ld_sp_16)
+    OPCODE(0x21, "LD HL, d16", 3, ld_hl_16)
+    OPCODE(0x11, "LD DE, d16", 3, ld_de_16)
+    OPCODE(0x01, "LD BC, d16", 3, ld_bc_16)
+
+    OPCODE(0xc7, "RST 0", 4, rst_0)
+    OPCODE(0xcf, "RST 1", 4, rst_1)
+    OPCODE(0xd7, "RST 2", 4, rst_2)
+    OPCODE(0xdf, "RST 3", 4, rst_3)
+    OPCODE(0xe7, "RST 4", 4, rst_4)
+    OPCODE(0xef, "RST 5", 4, rst_5)
+    OPCODE(0xf7, "RST 6", 4, rst_6)
+    OPCODE(0xff, "RST 7", 4, rst_7)
+
+    OPCODE(0x3c, "INC A", 1, inc_a)
+    OPCODE(0x2c, "INC L", 1, inc_l)
+    OPCODE(0x1c, "INC E", 1, inc_e)
+    OPCODE(0x0c, "INC C", 1, inc_c)
+    OPCODE(0x04, "INC B", 1, inc_b)
+    OPCODE(0x14, "INC D", 1, inc_d)
+    OPCODE(0x24, "INC H", 1, inc_h)
+    OPCODE(0x34, "INC (HL)", 3, inc_m)
+
+    OPCODE(0x03, "INC BC", 2, inc_bc)
+    OPCODE(0x13, "INC DE", 2, inc_de)
+    OPCODE(0x23, "INC HL", 2, inc_hl)
+    OPCODE(0x33, "INC SP", 2, inc_sp)
+
+    OPCODE(0x0B, "DEC BC", 2, dec_bc)
+    OPCODE(0x1B, "DEC DE", 2, dec_de)
+    OPCODE(0x2B, "DEC HL", 2, dec_hl)
+    OPCODE(0x3B, "DEC SP", 2, dec_sp)
+
+
+    OPCODE(0xc9, "RET", 4, ret)
+    OPCODE(0xc0, "RET NZ", 0, ret_nz)
+    OPCODE(0xd0, "RET NC", 0, ret_nc)
+    OPCODE(0xc8, "RET Z", 0, ret_z)
+    OPCODE(0xd8, "RET C", 0, ret_c)
+    OPCODE(0xd9, "RETI", 4, reti)
+
+    OPCODE(0x40, "LD B, B", 1, ld_b_b)
+    OPCODE(0x41, "LD B, C", 1, ld_b_c)
+    OPCODE(0x42, "LD B, D", 1, ld_b_d)
+    OPCODE(0x43, "LD B, E", 1, ld_b_e)
+    OPCODE(0x44, "LD B, H", 1, ld_b_h)
+    OPCODE(0x45, "LD B, L", 1, ld_b_l)
+    OPCODE(0x47, "LD B, A", 1, ld_b_a)
+    OPCODE(0x48, "LD C, B", 1, ld_c_b)
+    OPCODE(0x49, "LD C, C", 1, ld_c_c)
+    OPCODE(0x4A, "LD C, D", 1, ld_c_d)
+    OPCODE(0x4B, "LD C, E", 1, ld_c_e)
+    OPCODE(0x4C, "LD C, H", 1, ld_c_h)
+    OPCODE(0x4D, "LD C, L", 1, ld_c_l)
+    OPCODE(0x4F, "LD C, A", 1, ld_c_a)
+    OPCODE(0x46, "LD B, (HL)", 2, ld_b_m)
+    OPCODE(0x4E, "LD C, (HL)", 2, ld_c_m)
+
+    OPCODE(0x50, "LD D, B", 1, ld_d_b)
+    OPCODE(0x51, "LD D, C", 1, ld_d_c)
+    OPCODE(0x52, "LD D, D", 1, ld_d_d)
+    OPCODE(0x53, "LD D, E", 1, ld_d_e)
+    OPCODE(0x54, "LD D, H", 1, ld_d_h)
+    OPCODE(0x55, "LD D, L", 1, ld_d_l)
+    OPCODE(0x57, "LD D, A", 1, ld_d_a)
+    OPCODE(0x58, "LD E, B", 1, ld_e_b)
+    OPCODE(0x59, "LD E, C", 1, ld_e_c)
+    OPCODE(0x5A, "LD E, D", 1, ld_e_d)
+    OPCODE(0x5B, "LD E, E", 1, ld_e_e)
+    OPCODE(0x5C, "LD E, H", 1, ld_e_h)
+    OPCODE(0x5D, "LD E, L", 1, ld_e_l)
+    OPCODE(0x5F, "LD E, A", 1, ld_e_a)
+    OPCODE(0x56, "LD D, (HL)", 2, ld_d_m)
+    OPCODE(0x5E, "LD E, (HL)", 2, ld_e_m)
+
+
+    OPCODE(0x61, "LD H, C", 1, ld_h_c)
+    OPCODE(0x60, "LD H, B", 1, ld_h_b)
+    OPCODE(0x62, "LD H, D", 1, ld_h_d)
+    OPCODE(0x63, "LD H, E", 1, ld_h_e)
+    OPCODE(0x64, "LD H, H", 1, ld_h_h)
+    OPCODE(0x65, "LD H, L", 1, ld_h_l)
+    OPCODE(0x67, "LD H, A", 1, ld_h_a)
+    OPCODE(0x68, "LD L, B", 1, ld_l_b)
+    OPCODE(0x69, "LD L, C", 1, ld_l_c)
+    OPCODE(0x6A, "LD L, D", 1, ld_l_d)
+    OPCODE(0x6B, "LD L, E", 1, ld_l_e)
+    OPCODE(0x6C, "LD L, H", 1, ld_l_h)
+    OPCODE(0x6D, "LD L, L", 1, ld_l_l)
+    OPCODE(0x6F, "LD L, A", 1, ld_l_a)
+    OPCODE(0x66, "LD H, (HL)", 2, ld_h_m)
+    OPCODE(0x6E, "LD L, (HL)", 2, ld_l_m)
+
+    OPCODE(0x70, "LD (HL), B", 2, ld_m_b)
+    OPCODE(0x71, "LD (HL), C", 2, ld_m_c)
+    OPCODE(0x72, "LD (HL), D", 2, ld_m_d)
+    OPCODE(0x73, "LD (HL), E", 2, ld_m_e)
+    OPCODE(0x74, "LD (HL), H", 2, ld_m_h)
+    OPCODE(0x75, "LD (HL), L", 2, ld_m_l)
+    OPCODE(0x77, "LD (HL), A", 2, ld_m_a)
+    OPCODE(0x78, "LD A, B", 1, ld_a_b)
+    OPCODE(0x79, "LD A, C", 1, ld_a_c)
+    OPCODE(0x7A, "LD A, D", 1, ld_a_d)
+    OPCODE(0x7B, "LD A, E", 1, ld_a_e)
+    OPCODE(0x7C, "LD A, H", 1, ld_a_h)
+    OPCODE(0x7D, "LD A, L", 1, ld_a_l)
+    OPCODE(0x7F, "LD A, A", 1, ld_a_a)
+    OPCODE(0x7E, "LD A, (HL)", 2, ld_a_m)
+
+    OPCODE(0x02, "LD (BC), A", 2, ld_bc_a)
+    OPCODE(0x12, "LD (DE), A", 2, ld_de_a)
+    OPCODE(0x22, "LD (HL+), A", 2, ld_hlp_a)
+    OPCODE(0x32, "LD (HL-), A", 2, ld_hlm_a)
+    OPCODE(0x08, "LD (a16), SP", 5, ld_a16_sp)
+
+
+    OPCODE(0x06, "LD B, d8", 2, ld_b_d8)
+    OPCODE(0x16, "LD D, d8", 2, ld_d_d8)
+    OPCODE(0x26, "LD H, d8", 2, ld_h_d8)
+    OPCODE(0x36, "LD (HL), d8", 3, ld_m_d8)
+
+    OPCODE(0x0A, "LD A, (BC)", 2, ld_a_bc)
+    OPCODE(0x1A, "LD A, (DE)", 2, ld_a_de)
+    OPCODE(0x2A, "LD A, (HL+)", 2, ld_a_hlp)
+    OPCODE(0x3A, "LD A, (HL-)", 2, ld_a_hlm)
+
+    OPCODE(0x0E, "LD C, d8", 2, ld_c_d8)
+    OPCODE(0x1E, "LD E, d8", 2, ld_e_d8)
+    OPCODE(0x2E, "LD L, d8", 2, ld_l_d8)
+    OPCODE(0x3E, "LD A, d8", 2, ld_a_d8)
+
+    OPCODE(0xE0, "LD (a8), A", 3, ld_a8_a)
+    OPCODE(0xF0, "LD A, (a8)", 3, ld_a_a8)
+    OPCODE(0xEA, "LD (a16), A", 4, ld_a16_a)
+    OPCODE(0xFA, "LD A, (a16)", 4, ld_a_a16)
+    OPCODE(0xE2, "LD (m), A", 2, ld_mc_a)
+    OPCODE(0xF2, "LD A, (m)", 2, ld_a_mc)
+
+    OPCODE(0xf9, "LD SP, HL", 2, ld_sp_hl)
+    OPCODE(0xf8, "LD HL, SP + s8", 3, ld_hl_sp_s8)
+
+    OPCODE(0x80, "ADD B", 1, add_a_b)
+    OPCODE(0x81, "ADD C", 1, add_a_c)
+    OPCODE(0x82, "ADD D", 1, add_a_d)
+    OPCODE(0x83, "ADD E", 1, add_a_e)
+    OPCODE(0x84, "ADD H", 1, add_a_h)
+    OPCODE(0x85, "ADD L", 1, add_a_l)
+    OPCODE(0x86, "ADD M", 2, add_a_m)
+    OPCODE(0x87, "ADD A", 1, add_a_a)
+
+    OPCODE(0xE8, "ADD SP, s8", 4, add_sp_s8)
+
+    OPCODE(0x88, "ADc B", 1, adc_b)
+    OPCODE(0x89, "ADc C", 1, adc_c)
+    OPCODE(0x8A, "ADc D", 1, adc_d)
+    OPCODE(0x8B, "ADc E", 1, adc_e)
+    OPCODE(0x8C, "ADc H", 1, adc_h)
+    OPCODE(0x8D, "ADc L", 1, adc_l)
+    OPCODE(0x8E, "ADc M", 2, adc_m)
+    OPCODE(0x8F, "ADc A", 1, adc_a)
+    OPCODE(0x27, "DAA", 1, daa)
+    OPCODE(0x37, "SCF", 1, scf)
+
+    OPCODE(0x09, "ADD HL, BC", 2, add_hl_bc)
+    OPCODE(0x19, "ADD HL, DE", 2, add_hl_de)
+    OPCODE(0x29, "ADD HL, HL", 2, add_hl_hl)
+    OPCODE(0x39, "ADD HL, SP", 2, add_hl_sp)
+
+    OPCODE(0x90, "SUB B", 1, sub_b)
+    OPCODE(0x91, "SUB C", 1, sub_c)
+    OPCODE(0x92, "SUB D", 1, sub_d)
+    OPCODE(0x93, "SUB E", 1, sub_e)
+    OPCODE(0x94, "SUB H", 1, sub_h)
+    OPCODE(0x95, "SUB L", 1, sub_l)
+    OPCODE(0x96, "SUB M", 2, sub_m)
+    OPCODE(0x97, "SUB A", 1, sub_a)
+    OPCODE(0x98, "Sbc B", 1, sbc_b)
+    OPCODE(0x99, "Sbc C", 1, sbc_c)
+    OPCODE(0x9A, "Sbc D", 1, sbc_d)
+    OPCODE(0x9B, "Sbc E", 1, sbc_e)
+    OPCODE(0x9C, "Sbc H", 1, sbc_h)
+    OPCODE(0x9D, "Sbc L", 1, sbc_l)
+    OPCODE(0x9E, "Sbc M", 2, sbc_m)
+    OPCODE(0x9F, "Sbc A", 1, sbc_a)
+
+    OPCODE(0xA0, "and B", 1, and_b)
+    OPCODE(0xA1, "and C", 1, and_c)
+    OPCODE(0xA2, "and D", 1, and_d)
+    OPCODE(0xA3, "and E", 1, and_e)
+    OPCODE(0xA4, "and H", 1, and_h)
+    OPCODE(0xA5, "and L", 1, and_l)
+    OPCODE(0xA6, "and M", 2, and_m)
+    OPCODE(0xA7, "and A", 1, and_a)
+    OPCODE(0xA8, "XOR B", 1, xor_b)
+    OPCODE(0xA9, "XOR C", 1, xor_c)
+    OPCODE(0xAA, "XOR D", 1, xor_d)
+    OPCODE(0xAB, "XOR E", 1, xor_e)
+    OPCODE(0xAC, "XOR H", 1, xor_h)
+    OPCODE(0xAD, "XOR L", 1, xor_l)
+    OPCODE(0xAE, "XOR M", 2, xor_m)
+    OPCODE(0xAF, "XOR A", 1, xor_a)
+
+    OPCODE(0xB0, "or B", 1, or_b)
+    OPCODE(0xB1, "or C", 1, or_c)
+    OPCODE(0xB2, "or D", 1, or_d)
+    OPCODE(0xB3, "or E", 1, or_e)
+    OPCODE(0xB4, "or H", 1, or_h)
+    OPCODE(0xB5, "or L", 1, or_l)
+    OPCODE(0xB6, "or M", 2, or_m)
+    OPCODE(0xB7, "or A", 1, or_a)
+    OPCODE(0xB8, "CP B", 1, cp_b)
+    OPCODE(0xB9, "CP C", 1, cp_c)
+    OPCODE(0xBA, "CP D", 1, cp_d)
+    OPCODE(0xBB, "CP E", 1, cp_e)
+    OPCODE(0xBC, "CP H", 1, cp_h)
+    OPCODE(0xBD, "CP L", 1, cp_l)
+    OPCODE(0xBE, "CP M", 2, cp_m)
+    OPCODE(0xBF, "CP A", 1, cp_a)
+
+    OPCODE(0xC6, "ADD A, d8", 2, add_a_d8)
+    OPCODE(0xD6, "SUB A, d8", 2, sub_d8)
+    OPCODE(0xE6, "AND A, d8", 2, and_d8)
+    OPCODE(0xF6, "OR A, d8", 2, or_d8)
+    OPCODE(0x07, "RLCA", 1, rlca)
+    OPCODE(0x17, "RLA", 1, rla)
+
+
+    OPCODE(0xCE, "ADC A, d8", 2, adc_a_d8)
+    OPCODE(0xDE, "SBC A, d8", 2, sbc_d8)
+    OPCODE(0xEE, "XOR A, d8", 2, xor_d8)
+    OPCODE(0xFE, "CP A, d8", 2, cp_d8)
+
+    OPCODE(0x05, "DEC B", 1, dec_b)
+    OPCODE(0x15, "DEC D", 1, dec_d)
+    OPCODE(0x25, "DEC H", 1, dec_h)
+    OPCODE(0x35, "DEC (HL)", 3, dec_m)
+
+    OPCODE(0x0D, "DEC C", 1, dec_c)
+    OPCODE(0x1D, "DEC E", 1, dec_e)
+    OPCODE(0x2D, "DEC L", 1, dec_l)
+    OPCODE(0x3D, "DEC A", 1, dec_a)
+
+    OPCODE(0xCD, "CALL a16", 0, call_a16)
+    OPCODE(0xC4, "CALL NZ, a16", 0, call_nz_a16)
+    OPCODE(0xD4, "CALL NC, a16", 0, call_nc_a16)
+    OPCODE(0xCC, "CALL Z, a16", 0, call_z_a16)
+    OPCODE(0xDC, "CALL C, a16", 0, call_c_a16)
+
+    OPCODE(0xc1, "POP BC", 3, pop_bc)
+    OPCODE(0xd1, "POP DE", 3, pop_de)
+    OPCODE(0xe1, "POP HL", 3, pop_hl)
+    OPCODE(0xf1, "POP AF", 3, pop_af)
+
+    OPCODE(0xc5, "PUSH BC", 4, push_bc)
+    OPCODE(0xd5, "PUSH DE", 4, push_de)
+    OPCODE(0xe5, "PUSH HL", 4, push_hl)
+    OPCODE(0xf5, "PUSH AF", 4, push_af)
+
+    OPCODE(0x0f, "RRCA", 1, rrca)
+    OPCODE(0x1f, "RRA", 1, rra)
+
+    OPCODE(0xfb, "EI", 1, ei)
+
+    OPCODE(0x2f, "CPL", 1, cpl)
+    OPCODE(0x3f, "CCF", 1, ccf)
+
+    OPCODE(0x76, "HALT", 1, halt)
+
+/* CB prefixed */
+    CB_OPCODE(0x08, "RRC B", 2, rrc_b)
+    CB_OPCODE(0x09, "RRC C", 2, rrc_c)
+    CB_OPCODE(0x0A, "RRC D", 2, rrc_d)
+    CB_OPCODE(0x0B, "RRC E", 2, rrc_e)
+    CB_OPCODE(0x0C, "RRC H", 2, rrc_h)
+    CB_OPCODE(0x0D, "RRC L", 2, rrc_l)
+    CB_OPCODE(0x0E, "RRC (HL)", 4, rrc_hl)
+    CB_OPCODE(0x0F, "RRC A", 2, rrc_a)
+
+    CB_OPCODE(0x38, "SRL B", 2, srl_b)
+    CB_OPCODE(0x39, "SRL C", 2, srl_c)
+    CB_OPCODE(0x3A, "SRL D", 2, srl_d)
+    CB_OPCODE(0x3B, "SRL E", 2, srl_e)
+    CB_OPCODE(0x3C, "SRL H", 2, srl_h)
+    CB_OPCODE(0x3D, "SRL L", 2, srl_l)
+    CB_OPCODE(0x3E, "SRL (HL)", 4, srl_m)
+    CB_OPCODE(0x3F, "SRL A", 2, srl_a)
+
+
+    CB_OPCODE(0x18, "RR B", 2, rr_b)
+    CB_OPCODE(0x19, "RR C", 2, rr_c)
+    CB_OPCODE(0x1A, "RR D", 2, rr_d)
+    CB_OPCODE(0x1B, "RR E", 2, rr_e)
+    CB_OPCODE(0x1C, "RR H", 2, rr_h)
+    CB_OPCODE(0x1D, "RR L", 2, rr_l)
+    CB_OPCODE(0x1E, "RR (HL)", 4, rr_m)
+    CB_OPCODE(0x1F, "RR a", 2, rr_a)
+
+    CB_OPCODE(0x10, "RL B", 2, rl_b)
+    CB_OPCODE(0x11, "RL C", 2, rl_c)
+    CB_OPCODE(0x12, "RL D", 2, rl_d)
+    CB_OPCODE(0x13, "RL E", 2, rl_e)
+    CB_OPCODE(0x14, "RL H", 2, rl_h)
+    CB_OPCODE(0x15, "RL L", 2, rl_l)
+    CB_OPCODE(0x16, "RL (HL)", 4, rl_hl)
+    CB_OPCODE(0x17, "RL A", 2, rl_a)
+
+    CB_OPCODE(0x28, "SRA B", 2, sra_b)
+    CB_OPCODE(0x29, "SRA C", 2, sra_c)
+    CB_OPCODE(0x2A, "SRA D", 2, sra_d)
+    CB_OPCODE(0x2B, "SRA E", 2, sra_e)
+    CB_OPCODE(0x2C, "SRA H", 2, sra_h)
+    CB_OPCODE(0x2D, "SRA L", 2, sra_l)
+    CB_OPCODE(0x2E, "SRA (HL)", 4, sra_hl)
+    CB_OPCODE(0x2F, "SRA A", 2, sra_a)
+
+
+
+    CB_OPCODE(0x40, "BIT 0,B", 2, bit_0_b)
+    CB_OPCODE(0x41, "BIT 0,C", 2, bit_0_c)
+    CB_OPCODE(0x42, "BIT 0,D", 2, bit_0_d)
+    CB_OPCODE(0x43, "BIT 0,E", 2, bit_0_e)
+    CB_OPCODE(0x44, "BIT 0,H", 2, bit_0_h)
+    CB_OPCODE(0x45, "BIT 0,L", 2, bit_0_l)
+    CB_OPCODE(0x46, "BIT 0,(HL)", 3, bit_0_hl)
+    CB_OPCODE(0x47, "BIT 0,A", 2, bit_0_a)
+
+    CB_OPCODE(0x48, "BIT 1,B", 2, bit_1_b)
+    CB_OPCODE(0x49, "BIT 1,C", 2, bit_1_c)
+    CB_OPCODE(0x4A, "BIT 1,D", 2, bit_1_d)
+    CB_OPCODE(0x4B, "BIT 1,E", 2, bit_1_e)
+    CB_OPCODE(0x4C, "BIT 1,H", 2, bit_1_h)
+    CB_OPCODE(0x4D, "BIT 1,L", 2, bit_1_l)
+    CB_OPCODE(0x4E, "BIT 1,(HL)", 3, bit_1_hl)
+    CB_OPCODE(0x4F, "BIT 1,A", 2, bit_1_a)
+
+    CB_OPCODE(0x50, "BIT 2,B", 2, bit_2_b)
+    CB_OPCODE(0x51, "BIT 2,C", 2, bit_2_c)
+    CB_OPCODE(0x52, "BIT 2,D", 2, bit_2_d)
+    CB_OPCODE(0x53, "BIT 2,E", 2, bit_2_e)
+    CB_OPCODE(0x54, "BIT 2,H", 2, bit_2_h)
+    CB_OPCODE(0x55, "BIT 2,L", 2, bit_2_l)
+    CB_OPCODE(0x56, "BIT 2,(HL)", 3, bit_2_hl)
+    CB_OPCODE(0x57, "BIT 2,A", 2, bit_2_a)
+
+    CB_OPCODE(0x58, "BIT 3,B", 2, bit_3_b)
+    CB_OPCODE(0x59, "BIT 3,C", 2, bit_3_c)
+    CB_OPCODE(0x5A, "BIT 3,D", 2, bit_3_d)
+    CB_OPCODE(0x5B, "BIT 3,E", 2, bit_3_e)
+    CB_OPCODE(0x5C, "BIT 3,H", 2, bit_3_h)
+    CB_OPCODE(0x5D, "BIT 3,L", 2, bit_3_l)
+    CB_OPCODE(0x5E, "BIT 3,(HL)", 3, bit_3_hl)
+    CB_OPCODE(0x5F, "BIT 3,A", 2, bit_3_a)
+
+    CB_OPCODE(0x60, "BIT 4,B", 2, bit_4_b)
+    CB_OPCODE(0x61, "BIT 4,C", 2, bit_4_c)
+    CB_OPCODE(0x62, "BIT 4,D", 2, bit_4_d)
+    CB_OPCODE(0x63, "BIT 4,E", 2, bit_4_e)
+    CB_OPCODE(0x64, "BIT 4,H", 2, bit_4_h)
+    CB_OPCODE(0x65, "BIT 4,L", 2, bit_4_l)
+    CB_OPCODE(0x66, "BIT 4,(HL)", 3, bit_4_hl)
+    CB_OPCODE(0x67, "BIT 4,A", 2, bit_4_a)
+
+    CB_OPCODE(0x68, "BIT 5,B", 2, bit_5_b)
+    CB_OPCODE(0x69, "BIT 5,C", 2, bit_5_c)
+    CB_OPCODE(0x6A, "BIT 5,D", 2, bit_5_d)
+    CB_OPCODE(0x6B, "BIT 5,E", 2, bit_5_e)
+    CB_OPCODE(0x6C, "BIT 5,H", 2, bit_5_h)
+    CB_OPCODE(0x6D, "BIT 5,L", 2, bit_5_l)
+    CB_OPCODE(0x6E, "BIT 5,(HL)", 3, bit_5_hl)
+    CB_OPCODE(0x6F, "BIT 5,A", 2, bit_5_a)
+
+    CB_OPCODE(0x70, "BIT 6,B", 2, bit_6_b)
+    CB_OPCODE(0x71, "BIT 6,C", 2, bit_6_c)
+    CB_OPCODE(0x72, "BIT 6,D", 2, bit_6_d)
+    CB_OPCODE(0x73, "BIT 6,E", 2, bit_6_e)
+    CB_OPCODE(0x74, "BIT 6,H", 2, bit_6_h)
+    CB_OPCODE(0x75, "BIT 6,L", 2, bit_6_l)
+    CB_OPCODE(0x76, "BIT 6,(HL)", 3, bit_6_hl)
+    CB_OPCODE(0x77, "BIT 6,A", 2, bit_6_a)
+
+    CB_OPCODE(0x78, "BIT 7,B", 2, bit_7_b)
+    CB_OPCODE(0x79, "BIT 7,C", 2, bit_7_c)
+    CB_OPCODE(0x7A, "BIT 7,D", 2, bit_7_d)
+    CB_OPCODE(0x7B, "BIT 7,E", 2, bit_7_e)
+    CB_OPCODE(0x7C, "BIT 7,H", 2, bit_7_h)
+    CB_OPCODE(0x7D, "BIT 7,L", 2, bit_7_l)
+    CB_OPCODE(0x7E, "BIT 7,(HL)", 3, bit_7_hl)
+    CB_OPCODE(0x7F, "BIT 7,A", 2, bit_7_a)
+
+    // RES 0
+    CB_OPCODE(0x80, "RES 0,B", 2, res_0_b)
+    CB_OPCODE(0x81, "RES 0,C", 2, res_0_c)
+    CB_OPCODE(0x82, "RES 0,D", 2, res_0_d)
+    CB_OPCODE(0x83, "RES 0,E", 2, res_0_e)
+    CB_OPCODE(0x84, "RES 0,H", 2, res_0_h)
+    CB_OPCODE(0x85, "RES 0,L", 2, res_0_l)
+    CB_OPCODE(0x86, "RES 0,(HL)", 4, res_0_hl)
+    CB_OPCODE(0x87, "RES 0,A", 2, res_0_a)
+
+    // RES 1
+    CB_OPCODE(0x88, "RES 1,B", 2, res_1_b)
+    CB_OPCODE(0x89, "RES 1,C", 2, res_1_c)
+    CB_OPCODE(0x8A, "RES 1,D", 2, res_1_d)
+    CB_OPCODE(0x8B, "RES 1,E", 2, res_1_e)
+    CB_OPCODE(0x8C, "RES 1,H", 2, res_1_h)
+    CB_OPCODE(0x8D, "RES 1,L", 2, res_1_l)
+    CB_OPCODE(0x8E, "RES 1,(HL)", 4, res_1_hl)
+    CB_OPCODE(0x8F, "RES 1,A", 2, res_1_a)
+
+    // RES 2
+    CB_OPCODE(0x90, "RES 2,B", 2, res_2_b)
+    CB_OPCODE(0x91, "RES 2,C", 2, res_2_c)
+    CB_OPCODE(0x92, "RES 2,D", 2, res_2_d)
+    CB_OPCODE(0x93, "RES 2,E", 2, res_2_e)
+    CB_OPCODE(0x94, "RES 2,H", 2, res_2_h)
+    CB_OPCODE(0x95, "RES 2,L", 2, res_2_l)
+    CB_OPCODE(0x96, "RES 2,(HL)", 4, res_2_hl)
+    CB_OPCODE(0x97, "RES 2,A", 2, res_2_a)
+
+    // RES 3
+    CB_OPCODE(0x98, "RES 3,B", 2, res_3_b)
+    CB_OPCODE(0x99, "RES 3,C", 2, res_3_c)
+    CB_OPCODE(0x9A, "RES 3,D", 2, res_3_d)
+    CB_OPCODE(0x9B, "RES 3,E", 2, res_3_e)
+    CB_OPCODE(0x9C, "RES 3,H", 2, res_3_h)
+    CB_OPCODE(0x9D, "RES 3,L", 2, res_3_l)
+    CB_OPCODE(0x9E, "RES 3,(HL)", 4, res_3_hl)
+    CB_OPCODE(0x9F, "RES 3,A", 2, res_3_a)
+
+    // RES 4
+    CB_OPCODE(0xA0, "RES 4,B", 2, res_4_b)
+    CB_OPCODE(0xA1, "RES 4,C", 2, res_4_c)
+    CB_OPCODE(0xA2, "RES 4,D", 2, res_4_d)
+    CB_OPCODE(0xA3, "RES 4,E", 2, res_4_e)
+    CB_OPCODE(0xA4, "RES 4,H", 2, res_4_h)
+    CB_OPCODE(0xA5, "RES 4,L", 2, res_4_l)
+    CB_OPCODE(0xA6, "RES 4,(HL)", 4, res_4_hl)
+    CB_OPCODE(0xA7, "RES 4,A", 2, res_4_a)
+
+    // RES 5
+    CB_OPCODE(0xA8, "RES 5,B", 2, res_5_b)
+    CB_OPCODE(0xA9, "RES 5,C", 2, res_5_c)
+    CB_OPCODE(0xAA, "RES 5,D", 2, res_5_d)
+    CB_OPCODE(0xAB, "RES 5,E", 2, res_5_e)
+    CB_OPCODE(0xAC, "RES 5,H", 2, res_5_h)
+    CB_OPCODE(0xAD, "RES 5,L", 2, res_5_l)
+    CB_OPCODE(0xAE, "RES 5,(HL)", 4, res_5_hl)
+    CB_OPCODE(0xAF, "RES 5,A", 2, res_5_a)
+
+    // RES 6
+    CB_OPCODE(0xB0, "RES 6,B", 2, res_6_b)
+    CB_OPCODE(0xB1, "RES 6,C", 2, res_6_c)
+    CB_OPCODE(0xB2, "RES 6,D", 2, res_6_d)
+    CB_OPCODE(0xB3, "RES 6,E", 2, res_6_e)
+    CB_OPCODE(0xB4, "RES 6,H", 2, res_6_h)
+    CB_OPCODE(0xB5, "RES 6,L", 2, res_6_l)
+    CB_OPCODE(0xB6, "RES 6,(HL)", 4, res_6_hl)
+    CB_OPCODE(0xB7, "RES 6,A", 2, res_6_a)
+
+    // RES 7
+    CB_OPCODE(0xB8, "RES 7,B", 2, res_7_b)
+    CB_OPCODE(0xB9, "RES 7,C", 2, res_7_c)
+    CB_OPCODE(0xBA, "RES 7,D", 2, res_7_d)
+    CB_OPCODE(0xBB, "RES 7,E", 2, res_7_e)
+    CB_OPCODE(0xBC, "RES 7,H", 2, res_7_h)
+    CB_OPCODE(0xBD, "RES 7,L", 2, res_7_l)
+    CB_OPCODE(0xBE, "RES 7,(HL)", 4, res_7_hl)
+    CB_OPCODE(0xBF, "RES 7,A", 2, res_7_a)
+
+    // SET 0
+    CB_OPCODE(0xC0, "SET 0,B", 2, set_0_b)
+    CB_OPCODE(0xC1, "SET 0,C", 2, set_0_c)
+    CB_OPCODE(0xC2, "SET 0,D", 2, set_0_d)
+    CB_OPCODE(0xC3, "SET 0,E", 2, set_0_e)
+    CB_OPCODE(0xC4, "SET 0,H", 2, set_0_h)
+    CB_OPCODE(0xC5, "SET 0,L", 2, set_0_l)
+    CB_OPCODE(0xC6, "SET 0,(HL)", 4, set_0_hl)
+    CB_OPCODE(0xC7, "SET 0,A", 2, set_0_a)
+
+    // SET 1
+    CB_OPCODE(0xC8, "SET 1,B", 2, set_1_b)
+    CB_OPCODE(0xC9, "SET 1,C", 2, set_1_c)
+    CB_OPCODE(0xCA, "SET 1,D", 2, set_1_d)
+    CB_OPCODE(0xCB, "SET 1,E", 2, set_1_e)
+    CB_OPCODE(0xCC, "SET 1,H", 2, set_1_h)
+    CB_OPCODE(0xCD, "SET 1,L", 2, set_1_l)
+    CB_OPCODE(0xCE, "SET 1,(HL)", 4, set_1_hl)
+    CB_OPCODE(0xCF, "SET 1,A", 2, set_1_a)
+
+    // SET 2
+    CB_OPCODE(0xD0, "SET 2,B", 2, set_2_b)
+    CB_OPCODE(0xD1, "SET 2,C", 2, set_2_c)
+    CB_OPCODE(0xD2, "SET 2,D", 2, set_2_d)
+    CB_OPCODE(0xD3, "SET 2,E", 2, set_2_e)
+    CB_OPCODE(0xD4, "SET 2,H", 2, set_2_h)
+    CB_OPCODE(0xD5, "SET 2,L", 2, set_2_l)
+    CB_OPCODE(0xD6, "SET 2,(HL)", 4, set_2_hl)
+    CB_OPCODE(0xD7, "SET 2,A", 2, set_2_a)
+
+    // SET 3
+    CB_OPCODE(0xD8, "SET 3,B", 2, set_3_b)
+    CB_OPCODE(0xD9, "SET 3,C", 2, set_3_c)
+    CB_OPCODE(0xDA, "SET 3,D", 2, set_3_d)
+    CB_OPCODE(0xDB, "SET 3,E", 2, set_3_e)
+    CB_OPCODE(0xDC, "SET 3,H", 2, set_3_h)
+    CB_OPCODE(0xDD, "SET 3,L", 2, set_3_l)
+    CB_OPCODE(0xDE, "SET 3,(HL)", 4, set_3_hl)
+    CB_OPCODE(0xDF, "SET 3,A", 2, set_3_a)
+
+    // SET 4
+    CB_OPCODE(0xE0, "SET 4,B", 2, set_4_b)
+    CB_OPCODE(0xE1, "SET 4,C", 2, set_4_c)
+    CB_OPCODE(0xE2, "SET 4,D", 2, set_4_d)
+    CB_OPCODE(0xE3, "SET 4,E", 2, set_4_e)
+    CB_OPCODE(0xE4, "SET 4,H", 2, set_4_h)
+    CB_OPCODE(0xE5, "SET 4,L", 2, set_4_l)
+    CB_OPCODE(0xE6, "SET 4,(HL)", 4, set_4_hl)
+    CB_OPCODE(0xE7, "SET 4,A", 2, set_4_a)
+
+    // SET 5
+    CB_OPCODE(0xE8, "SET 5,B", 2, set_5_b)
+    CB_OPCODE(0xE9, "SET 5,C", 2, set_5_c)
+    CB_OPCODE(0xEA, "SET 5,D", 2, set_5_d)
+    CB_OPCODE(0xEB, "SET 5,E", 2, set_5_e)
+    CB_OPCODE(0xEC, "SET 5,H", 2, set_5_h)
+    CB_OPCODE(0xED, "SET 5,L", 2, set_5_l)
+    CB_OPCODE(0xEE, "SET 5,(HL)", 4, set_5_hl)
+    CB_OPCODE(0xEF, "SET 5,A", 2, set_5_a)
+
+    // SET 6
+    CB_OPCODE(0xF0, "SET 6,B", 2, set_6_b)
+    CB_OPCODE(0xF1, "SET 6,C", 2, set_6_c)
+    CB_OPCODE(0xF2, "SET 6,D", 2, set_6_d)
+    CB_OPCODE(0xF3, "SET 6,E", 2, set_6_e)
+    CB_OPCODE(0xF4, "SET 6,H", 2, set_6_h)
+    CB_OPCODE(0xF5, "SET 6,L", 2, set_6_l)
+    CB_OPCODE(0xF6, "SET 6,(HL)", 4, set_6_hl)
+    CB_OPCODE(0xF7, "SET 6,A", 2, set_6_a)
+
+    // SET 7
+    CB_OPCODE(0xF8, "SET 7,B", 2, set_7_b)
+    CB_OPCODE(0xF9, "SET 7,C", 2, set_7_c)
+    CB_OPCODE(0xFA, "SET 7,D", 2, set_7_d)
+    CB_OPCODE(0xFB, "SET 7,E", 2, set_7_e)
+    CB_OPCODE(0xFC, "SET 7,H", 2, set_7_h)
+    CB_OPCODE(0xFD, "SET 7,L", 2, set_7_l)
+    CB_OPCODE(0xFE, "SET 7,(HL)", 4, set_7_hl)
+    CB_OPCODE(0xFF, "SET 7,A", 2, set_7_a)
+
+
+    CB_OPCODE(0x37, "SWAP A", 2, swap_a)
+    CB_OPCODE(0x30, "SWAP B", 2, swap_b)
+    CB_OPCODE(0x31, "SWAP C", 2, swap_c)
+    CB_OPCODE(0x32, "SWAP D", 2, swap_d)
+    CB_OPCODE(0x33, "SWAP E", 2, swap_e)
+    CB_OPCODE(0x34, "SWAP H", 2, swap_h)
+    CB_OPCODE(0x35, "SWAP L", 2, swap_l)
+    CB_OPCODE(0x36, "SWAP (HL)", 4, swap_hl)
+
+    CB_OPCODE(0x20, "SLA B", 2, sla_b)
+    CB_OPCODE(0x21, "SLA C", 2, sla_c)
+    CB_OPCODE(0x22, "SLA D", 2, sla_d)
+    CB_OPCODE(0x23, "SLA E", 2, sla_e)
+    CB_OPCODE(0x24, "SLA H", 2, sla_h)
+    CB_OPCODE(0x25, "SLA L", 2, sla_l)
+    CB_OPCODE(0x26, "SLA (HL)", 4, sla_hl)
+    CB_OPCODE(0x27, "SLA A", 2, sla_a)
+
+    CB_OPCODE(0x00, "RLC B", 2, rlc_b)
+    CB_OPCODE(0x01, "RLC C", 2, rlc_c)
+    CB_OPCODE(0x02, "RLC D", 2, rlc_d)
+    CB_OPCODE(0x03, "RLC E", 2, rlc_e)
+    CB_OPCODE(0x04, "RLC H", 2, rlc_h)
+    CB_OPCODE(0x05, "RLC L", 2, rlc_l)
+    CB_OPCODE(0x06, "RLC (HL)", 4, rlc_hl)
+    CB_OPCODE(0x07, "RLC A", 2, rlc_a)
+
+#undef OPCODE
+#undef CB_OPCODE
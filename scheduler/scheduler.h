@@ -0,0 +1,38 @@
+/*  scheduler.h
+ *
+ *  Deadlines on the master clock (CPU.cycles) the main loop runs the CPU up to.
+ *  Every component posts the M-cycle at which its state next changes in a way
+ *  the CPU could see, the CPU runs uninterrupted until the earliest one.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "../platform/platform.h"
+
+typedef enum {
+    EVENT_TIMER,    // TIMA overflow requests the interrupt, DIV and TIMA reads catch up by themselves
+    EVENT_PPU,      // mode transition, LY / STAT change and VBlank / STAT requests
+    EVENT_COUNT,
+} EventKind;
+
+typedef struct {
+    const u64 *clock;           // the master clock, CPU.cycles
+    u64 deadline[EVENT_COUNT];  // absolute M-cycle
+    u64 next;                   // earliest deadline
+} Scheduler;
+
+static inline Scheduler make_scheduler(const u64 *clock){
+    Scheduler s = {.clock = clock, .next = 0};
+    for (int i = 0; i < EVENT_COUNT; i++) s.deadline[i] = 0;
+    return s;
+}
+
+/* Posts a component's next deadline, cycles from now */
+static inline void scheduler_post(Scheduler *s, EventKind kind, int cycles){
+    s->deadline[kind] = *s->clock + cycles;
+
+    s->next = s->deadline[0];
+    for (int i = 1; i < EVENT_COUNT; i++)
+        if (s->deadline[i] < s->next) s->next = s->deadline[i];
+}
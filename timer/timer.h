@@ -12,79 +12,145 @@
 typedef struct {
     CPU *cpu;
 
-    int div_cycles;
-    u16 div_counter;
+    u64 synced;     // master clock TIMA and the DIV register were last brought up to
+    u64 div_epoch;  // master clock of the last DIV reset, the internal counter runs 4 per M-cycle from it
     u8 prev_res;
 
     InterruptManager *ih;
 
 } Timer_Manager;
 
-Timer_Manager make_timer(CPU *cpu, InterruptManager *ih){
+static inline Timer_Manager make_timer(CPU *cpu, InterruptManager *ih){
     return (Timer_Manager){
         .cpu = cpu,
         .ih = ih,
-        .div_cycles = 0,
+        .synced = cpu->cycles,
+        .div_epoch = cpu->cycles,
         .prev_res = 0,
-        .div_counter = 0,
     };
 }
 
-u8 mem_read(Timer_Manager *t, u16 addr){
-    return memory_read_8(t->cpu->p_memory, addr);
+/* Internal 16 bit DIV counter at a point of the master clock */
+static inline u16 timer_div_counter(const Timer_Manager *t, u64 at){
+    return (u16)((at - t->div_epoch) * 4);
 }
 
-u8 *mem_ptr(Timer_Manager *t, u16 addr){
-    return get_address(t->cpu->p_memory, addr,true);
+/* The timer's own registers are plain storage, read them without syncing */
+static inline u8 mem_read(Timer_Manager *t, u16 addr){
+    return *get_address(t->cpu->p_memory, addr, false);
 }
 
-void inc_mem(Timer_Manager *t, u16 addr){
-    u8 *val =  get_address(t->cpu->p_memory, addr,true);
-    (*val) ++;
+static inline u8 *mem_ptr(Timer_Manager *t, u16 addr){
+    return get_address(t->cpu->p_memory, addr,true);
 }
 
-void timer_reset_div(Timer_Manager *t){
-    // Writing any value to DIV resets the internal counter
-    t->div_counter = 0;
+static inline void timer_reset_div(Timer_Manager *t){
+    // Writing any value to DIV resets the internal counter, the io_sync hook has brought the timer to now
+    t->div_epoch = t->synced;
     t->cpu->p_memory->IO[4] =  0;
 }
 
+static inline void timer_div_write(void *ctx, u16 addr, u8 data){
+    (void)addr;
+    (void)data;
+    timer_reset_div(ctx);
+}
 
-void timer_step(Timer_Manager *t, int m_cycles)
-{
-    if (t->cpu->p_memory->is_div_reset == true) timer_reset_div(t);
+static inline void timer_register_io(Timer_Manager *t){
+    memory_register_io(t->cpu->p_memory, DIV, NULL, timer_div_write, t);
+}
 
-    for (int i = 0; i < m_cycles * 4; i++) {
+/* DIV counter bit selected by TAC, and the falling edge period of that bit */
+static const u8 timer_tac_bits[4] = {9, 3, 5, 7};
+#define TIMER_PERIOD(tac) (2u << timer_tac_bits[(tac) & 0b11])
 
-        t->div_counter++;
+/* Selected DIV bit ANDed with the timer enable, TIMA ticks when it falls */
+static inline u8 timer_and_result(u8 tac, u32 counter){
+    return ((counter >> timer_tac_bits[tac & 0b11]) & 1) & ((tac >> 2) & 1);
+}
 
-        u8 *div = get_address(t->cpu->p_memory, DIV, false);
-        *div = (t->div_counter >> 8) & 0xFF;
+/* Timer queries return TIMER_IDLE when nothing can happen */
+#define TIMER_IDLE 0x7FFFFFFF
 
-        u8 tac = mem_read(t, TAC);
-        u8 t_en = (tac >> 2) & 1;
+/* M-cycles until TIMA has been incremented edges times */
+static inline int timer_cycles_to_edges(Timer_Manager *t, int edges){
+    u8 tac = mem_read(t, TAC);
+    u32 period = TIMER_PERIOD(tac);
 
-        u8 test_bit;
-        switch (tac & 0b11) {
-            case 0: test_bit = (t->div_counter >> 9) & 1; break;
-            case 1: test_bit = (t->div_counter >> 3) & 1; break;
-            case 2: test_bit = (t->div_counter >> 5) & 1; break;
-            case 3: test_bit = (t->div_counter >> 7) & 1; break;
-        }
+    // a TAC write since the last step can make the next tick a falling edge
+    u16 counter = timer_div_counter(t, t->synced);
+    if (timer_and_result(tac, counter) != t->prev_res) return 1;
+    if (!(tac & 0b100)) return TIMER_IDLE;
 
-        u8 and_result = test_bit & t_en;
+    // edges come each time the counter crosses a multiple of period
+    long t_cycles = (period - (counter & (period - 1))) + (long)(edges - 1) * period;
+    return (t_cycles + 3) / 4;
+}
 
-        if (t->prev_res == 1 && and_result == 0) {
-            u8 tima = mem_read(t, TIMA);
-            if (tima == 0xFF) {
-                *get_address(t->cpu->p_memory, TIMA, true) =
-                    mem_read(t, TMA);
-                request_interrupt(t->ih, Timer);
-            } else {
-                inc_mem(t, TIMA);
-            }
-        }
+/* M-cycles until TIMA overflows and requests the timer interrupt */
+static inline int timer_cycles_to_overflow(Timer_Manager *t){
+    return timer_cycles_to_edges(t, 0x100 - mem_read(t, TIMA));
+}
+
+/* M-cycles until the register at addr can read differently, an overflow for anything but DIV and TIMA */
+static inline int timer_cycles_to_change(Timer_Manager *t, u16 addr){
+    int overflow = timer_cycles_to_overflow(t);
 
-        t->prev_res = and_result;
+    if (addr == DIV){
+        int div = (0x100 - (timer_div_counter(t, t->synced) & 0xFF) + 3) / 4;
+        return div < overflow ? div : overflow;
     }
-}
\ No newline at end of file
+    if (addr == TIMA) return timer_cycles_to_edges(t, 1);
+    return overflow;
+}
+
+/* M-cycles until the timer next does something the CPU sees without reading it, the interrupt request */
+static inline int timer_cycles_to_event(Timer_Manager *t){
+    return timer_cycles_to_overflow(t);
+}
+
+/*  Advances the DIV counter by the whole step and applies the TIMA ticks at once.
+ *  The selected bit falls every time the counter reaches a multiple of its period,
+ *  only the first tick can differ from that, when TAC changed since the last step.
+ */
+static inline void timer_step(Timer_Manager *t, int m_cycles)
+{
+    if (m_cycles <= 0) return;
+
+    u8 tac = mem_read(t, TAC);
+    u32 period = TIMER_PERIOD(tac);
+    u32 start = timer_div_counter(t, t->synced);
+    u32 end = start + (u32)m_cycles * 4;
+
+    long edges = 0;
+    if (tac & 0b100)
+        edges = end / period - start / period;
+
+    // the first tick compares against prev_res, not the bit before it
+    u8 first = timer_and_result(tac, start + 1);
+    if (timer_and_result(tac, start) == 1 && first == 0) edges--;
+    if (t->prev_res == 1 && first == 0) edges++;
+
+    t->synced += m_cycles;
+    t->prev_res = timer_and_result(tac, end);
+    t->cpu->p_memory->IO[DIV - 0xFF00] = (end >> 8) & 0xFF;
+
+    if (edges <= 0) return;
+
+    u8 tima = mem_read(t, TIMA);
+    if (edges < 0x100 - tima){
+        *mem_ptr(t, TIMA) = tima + edges;
+        return;
+    }
+
+    // overflow reloads TMA, later overflows come every 0x100 - TMA ticks
+    u8 tma = mem_read(t, TMA);
+    edges -= 0x100 - tima;
+    *mem_ptr(t, TIMA) = tma + edges % (0x100 - tma);
+    request_interrupt(t->ih, Timer);
+}
+
+/* Brings the timer up to the master clock */
+static inline void timer_sync(Timer_Manager *t){
+    timer_step(t, (int)(t->cpu->cycles - t->synced));
+}